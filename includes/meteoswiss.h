@@ -27,6 +27,40 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Default hard cap on the size of a response body, in bytes.
+ */
+#define METEOSWISS_DEFAULT_MAX_RESPONSE_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief Status codes returned by the query functions.
+ */
+typedef enum {
+    METEOSWISS_SUCCESS = 0,
+    METEOSWISS_ERROR = -1,                    // Generic failure (network, parsing, validation)
+    METEOSWISS_ERROR_RESPONSE_TOO_LARGE = -2, // The response body exceeded the configured cap
+    METEOSWISS_ERROR_RATE_LIMITED = -3,       // The rate limiter had no slot for the query before its timeout
+    METEOSWISS_ERROR_CIRCUIT_OPEN = -4,       // The upstream is considered unhealthy, no request was sent
+    METEOSWISS_ERROR_UNSUPPORTED = -5         // The feature is not available with this platform or libcurl
+} MeteoSwissStatus;
+
+/**
+ * @brief States of the client circuit breaker.
+ */
+typedef enum {
+    METEOSWISS_CIRCUIT_CLOSED = 0,   // Requests are sent normally
+    METEOSWISS_CIRCUIT_OPEN = 1,     // Requests fail immediately until the open period ends
+    METEOSWISS_CIRCUIT_HALF_OPEN = 2 // A single probe request decides whether to close or reopen
+} MeteoSwissCircuitState;
+
+/**
+ * @brief Lanes of the client rate limiter.
+ */
+typedef enum {
+    METEOSWISS_PRIORITY_INTERACTIVE = 0, // Served first, for user-facing lookups
+    METEOSWISS_PRIORITY_BACKGROUND = 1   // Only served while no interactive query waits, for bulk refreshes
+} MeteoSwissPriority;
+
 /**
  * @brief Represents the current weather data.
  */
@@ -60,6 +94,7 @@ typedef struct {
     // Arrays to store graph data
     float *precipitation10m;
     size_t precipitation10m_count;
+    size_t precipitation10m_capacity; // Allocated entries, 0 if unknown
     // Add other arrays as needed
 } WeatherGraph;
 
@@ -70,6 +105,7 @@ typedef struct {
     CurrentWeather currentWeather;
     ForecastEntry *forecast;
     size_t forecast_count;
+    size_t forecast_capacity; // Allocated entries, 0 if unknown
     WeatherGraph graph;
     // Add other fields if needed
 } MeteoSwissData;
@@ -79,10 +115,533 @@ typedef struct {
  *
  * @param postal_code The postal code to query (e.g., 1201 for Geneva).
  * @param data Pointer to a MeteoSwissData structure to store the result.
- * @return 0 on success, non-zero on failure.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
  */
 int meteoswiss_query(int postal_code, MeteoSwissData *data, unsigned int timeout_ms);
 
+/**
+ * @brief Fetches and parses weather data for many postal codes concurrently.
+ *
+ * Up to max_in_flight requests are in progress at the same time, so the total
+ * time is bounded by bandwidth rather than by the sum of round-trip latencies.
+ * Every entry of data is initialized, including failed ones, and must be freed
+ * with meteoswiss_data_free().
+ *
+ * @param postal_codes The postal codes to query.
+ * @param count The number of postal codes.
+ * @param data Array of count MeteoSwissData structures receiving the results.
+ * @param status Optional array of count status codes, one per postal code.
+ * @param max_in_flight The maximum number of concurrent requests, 0 for the default.
+ * @param timeout_ms The timeout of each request in milliseconds, 0 for none.
+ * @return 0 if every query succeeded, a negative MeteoSwissStatus otherwise.
+ */
+int meteoswiss_query_batch(const int *postal_codes, size_t count, MeteoSwissData *data, int *status,
+                           size_t max_in_flight, unsigned int timeout_ms);
+
+/**
+ * @brief Opaque client context for repeated queries.
+ *
+ * A client owns long-lived HTTP handles, so the TCP connection and the TLS
+ * session to the MeteoSwiss server are reused between queries instead of
+ * being renegotiated for every call.
+ *
+ * A client can be used by several threads at the same time. Each concurrent
+ * query gets its own HTTP handle, and concurrent queries for the same postal
+ * code share a single fetch and parse.
+ */
+typedef struct meteoswiss_client meteoswiss_client_t;
+
+/**
+ * @brief Opaque caches shared by client contexts across threads.
+ *
+ * Clients attached to the same share reuse each other's DNS results and TLS
+ * sessions, so a cold connection on one thread resumes the TLS session
+ * negotiated by another. Each client keeps its own connection pool.
+ */
+typedef struct meteoswiss_share meteoswiss_share_t;
+
+/**
+ * @brief Creates a share object.
+ *
+ * The share is thread-safe and must outlive every client attached to it.
+ *
+ * @return The new share, or NULL on failure.
+ */
+meteoswiss_share_t *meteoswiss_share_create(void);
+
+/**
+ * @brief Destroys a share object, after every client attached to it.
+ *
+ * @param share The share to destroy, may be NULL.
+ */
+void meteoswiss_share_destroy(meteoswiss_share_t *share);
+
+/**
+ * @brief Saves the TLS sessions of a share to a file.
+ *
+ * Together with meteoswiss_share_load_tls_sessions(), lets a short-lived
+ * process resume the TLS sessions of the previous one, so even its first
+ * request skips the full handshake. Typically called before destroying the
+ * share. The file is replaced atomically and is only meant to be read back on
+ * the same machine; it grants the resumption of the sessions, keep it private.
+ *
+ * Requires libcurl 8.12.0 or later, with a TLS backend able to export sessions.
+ *
+ * @param share The share.
+ * @param path The file to write.
+ * @return 0 on success, METEOSWISS_ERROR_UNSUPPORTED without support, another
+ *         negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_share_save_tls_sessions(meteoswiss_share_t *share, const char *path);
+
+/**
+ * @brief Loads TLS sessions saved by meteoswiss_share_save_tls_sessions() into a share.
+ *
+ * Typically called right after creating the share. Expired sessions are skipped.
+ * A corrupt file, like one with a session libcurl rejects, fails with
+ * METEOSWISS_ERROR, keeping the sessions read before the corruption.
+ *
+ * @param share The share.
+ * @param path The file to read.
+ * @return 0 on success, METEOSWISS_ERROR_UNSUPPORTED without support, another
+ *         negative MeteoSwissStatus on failure, like a missing file.
+ */
+int meteoswiss_share_load_tls_sessions(meteoswiss_share_t *share, const char *path);
+
+/**
+ * @brief Opaque transport performing the HTTP requests of client contexts.
+ *
+ * Clients use the HTTP backend of the platform unless a transport is set in
+ * their configuration. The recorder and replayer transports capture the
+ * responses of the live service and serve them back offline.
+ */
+typedef struct meteoswiss_transport meteoswiss_transport_t;
+
+/**
+ * @brief Creates a transport recording every response into a directory.
+ *
+ * Requests go to the platform HTTP backend. Each response is written with its
+ * status, validators and phase timings to one file per URL in directory,
+ * replacing the previous recording of that URL. Not available on ESP32.
+ *
+ * @param directory Existing directory receiving the recordings.
+ * @return The new transport, or NULL on failure.
+ */
+meteoswiss_transport_t *meteoswiss_transport_recorder_create(const char *directory);
+
+/**
+ * @brief Creates a transport serving the responses recorded in a directory.
+ *
+ * Every recording is memory-mapped when the transport is created, so requests
+ * are answered without network or file I/O. A URL without recording fails.
+ * Conditional requests get a 304 when the validators match. Not available on
+ * ESP32.
+ *
+ * @param directory Directory filled by a recorder transport.
+ * @param simulate_latency Wait for the recorded duration of each request before answering.
+ * @return The new transport, or NULL on failure.
+ */
+meteoswiss_transport_t *meteoswiss_transport_replayer_create(const char *directory, int simulate_latency);
+
+/**
+ * @brief Destroys a transport, after every client using it.
+ *
+ * @param transport The transport to destroy, may be NULL.
+ */
+void meteoswiss_transport_destroy(meteoswiss_transport_t *transport);
+
+/**
+ * @brief Configuration of a client context.
+ *
+ * Initialize with meteoswiss_client_config_init() before changing fields.
+ */
+typedef struct {
+    long keepalive_idle_s;     // Idle time before TCP keep-alive probes are sent, in seconds
+    long keepalive_interval_s; // Interval between TCP keep-alive probes, in seconds
+    long max_idle_s;           // Idle connections older than this are not reused, in seconds
+    size_t max_response_size;  // Hard cap on a response body in bytes, 0 for no cap
+    int http2;                 // Negotiate HTTP/2 and multiplex concurrent requests over one connection
+    long max_concurrent_streams; // Maximum HTTP/2 streams per connection, 0 for the libcurl default
+    meteoswiss_share_t *share; // Caches shared with other clients, NULL for none
+    meteoswiss_transport_t *transport; // Performs the requests, NULL for the platform HTTP backend
+    int compression;           // Request a compressed body (gzip, deflate, br, zstd), decoded on the fly
+    int conditional_get;       // Revalidate with ETag/Last-Modified, reusing the previous result on 304
+    int streaming_parse;       // Parse single queries while the body downloads instead of after it
+    unsigned int warm_connections; // Connections opened in the background at creation, 0 for none
+    const char *base_url;      // Scheme and host of the service, like "http://localhost", NULL for MeteoSwiss
+    const char *unix_socket_path; // Connect to this Unix socket instead of the host of base_url, NULL for TCP
+    unsigned int dns_refresh_s; // Resolve the host in the background every this many seconds, 0 to resolve per connection
+
+    // Retries of single queries, within the timeout of the query
+    unsigned int max_attempts;    // Attempts per query including the first one, 0 or 1 for no retry
+    unsigned int backoff_base_ms; // Backoff before the first retry, doubled for each next one, fully jittered
+    unsigned int backoff_max_ms;  // Upper bound of the backoff
+    long connect_timeout_ms;      // Limit on establishing a connection, 0 for the libcurl default
+    long low_speed_limit;         // Abort a transfer slower than this many bytes per second...
+    long low_speed_time_s;        // ...during this many seconds, 0 to disable
+    int hedge;                    // Send a second request when the first one is slow, take the first answer
+    unsigned int hedge_delay_ms;  // Delay before the second request, 0 for the p95 latency of recent queries
+
+    // Token bucket limiting the requests sent upstream, shared by the threads using the client
+    double rate_limit;            // Requests per second, 0 for no limit
+    unsigned int rate_burst;      // Requests that may be sent at once after an idle period, 0 for the rate rounded up
+
+    // Circuit breaker failing queries immediately while the upstream is unhealthy
+    unsigned int breaker_failure_percent; // Open when this share of the recent requests failed, 0 to disable
+    unsigned int breaker_min_requests;    // Recent requests needed before the share is considered
+    unsigned int breaker_slow_ms;         // Requests slower than this count as failures, 0 to ignore latency
+    unsigned int breaker_open_ms;         // Time spent open before a probe request is let through
+} MeteoSwissClientConfig;
+
+/**
+ * @brief Details about a single query, filled by meteoswiss_client_query_ex().
+ *
+ * Durations are in microseconds. Network phases skipped on a reused connection
+ * are 0, and so are the ones the platform backend cannot measure.
+ */
+typedef struct meteoswiss_query_stats {
+    long http_status; // HTTP status of the response, 0 if none was received
+    int not_modified; // Set when the server confirmed the previous result is still current
+    int coalesced;    // Set when the result came from the fetch of a concurrent query
+    unsigned int attempts; // Requests made, more than 1 when the query was retried
+    int hedged;       // Set when a second request was sent because the first one was slow
+    long long throttle_us; // Time spent waiting for the rate limiter
+
+    // Network phases of the request
+    long long dns_us;      // Name resolution
+    long long connect_us;  // TCP connect
+    long long tls_us;      // TLS handshake
+    long long wait_us;     // From the request being sent to the first response byte
+    long long transfer_us; // From the first to the last response byte
+    long long total_us;    // Whole request
+
+    long long bytes_received; // Body bytes received on the wire, before decompression
+    size_t body_size;         // Body size after decompression
+
+    // CPU time spent on the response
+    long long parse_us;    // Single pass parsing, validating and extracting the response
+} MeteoSwissQueryStats;
+
+/**
+ * @brief Fills a client configuration with the default values.
+ *
+ * @param config Pointer to the configuration to initialize.
+ */
+void meteoswiss_client_config_init(MeteoSwissClientConfig *config);
+
+/**
+ * @brief Creates a client context.
+ *
+ * The strings of the configuration are copied. base_url and unix_socket_path
+ * point the client at a local caching proxy: with "http://localhost" and the
+ * path of its socket, requests skip TLS and the loopback TCP stack. Unix
+ * sockets are not available on ESP32.
+ *
+ * With dns_refresh_s set, a background thread resolves the host of base_url
+ * and new connections use its addresses instead of waiting for a lookup. The
+ * previous addresses are kept while a refresh fails. The addresses are not
+ * pinned on ESP32.
+ *
+ * @param config The client configuration, or NULL for the defaults.
+ * @return The new client, or NULL on failure.
+ */
+meteoswiss_client_t *meteoswiss_client_create(const MeteoSwissClientConfig *config);
+
+/**
+ * @brief Waits until the connections of a client are warm.
+ *
+ * With warm_connections set, meteoswiss_client_create() returns at once and
+ * a background thread resolves the host and opens that many connections,
+ * TLS handshake included, so the first queries do not pay for it. Queries
+ * may be made during the warm-up, they just do not benefit from it yet.
+ *
+ * @param client The client context.
+ * @param timeout_ms The maximum wait in milliseconds, 0 for none.
+ * @return 0 once at least one connection is warm or when no warm-up was
+ *         configured, METEOSWISS_ERROR if every connection failed or the
+ *         warm-up did not complete in time.
+ */
+int meteoswiss_client_wait_ready(meteoswiss_client_t *client, unsigned int timeout_ms);
+
+/**
+ * @brief Destroys a client context and closes its connections.
+ *
+ * No query may be in progress on the client. A warm-up still in progress is
+ * waited for.
+ *
+ * @param client The client to destroy, may be NULL.
+ */
+void meteoswiss_client_destroy(meteoswiss_client_t *client);
+
+/**
+ * @brief Fetches and parses weather data using a client context.
+ *
+ * Same as meteoswiss_query(), but reuses the connection held by the client.
+ * If another thread is already querying the same postal code on this client,
+ * no request is sent: the call waits for that query and receives its own copy
+ * of the result. The wait is bounded by timeout_ms.
+ *
+ * @param client The client context.
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_client_query(meteoswiss_client_t *client, int postal_code, MeteoSwissData *data, unsigned int timeout_ms);
+
+/**
+ * @brief Fetches and parses weather data using a client context, reporting query details.
+ *
+ * With conditional_get enabled, the client remembers the ETag and Last-Modified
+ * validators of each postal code. When the server answers 304 Not Modified,
+ * data receives a copy of the previous result without any parsing, and
+ * stats->not_modified is set.
+ *
+ * The stats break the latency of the query down into network phases and the
+ * CPU time of parsing, validation and extraction. A query that joined the
+ * fetch of a concurrent one reports the details of that fetch.
+ *
+ * With max_attempts above 1, transport failures and 5xx/429 answers are
+ * retried after a jittered backoff, as long as the timeout of the query
+ * allows. timeout_ms then bounds the whole query rather than each attempt.
+ * With hedge set, an attempt still waiting for an answer after the hedge
+ * delay is raced against a second identical request. Hedged attempts are
+ * parsed once downloaded, even with streaming_parse.
+ *
+ * @param client The client context.
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @param stats Optional structure receiving the query details, may be NULL.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_client_query_ex(meteoswiss_client_t *client, int postal_code, MeteoSwissData *data,
+                               unsigned int timeout_ms, MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Fetches and parses weather data for a given postal code, reporting query details.
+ *
+ * Same as meteoswiss_query(), but fills stats with the duration of each phase
+ * of the request and of the parsing, see meteoswiss_client_query_ex().
+ *
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @param stats Optional structure receiving the query details, may be NULL.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_query_ex(int postal_code, MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Returns the state of the circuit breaker of a client.
+ *
+ * With breaker_failure_percent set, the client tracks the outcome of its
+ * recent requests: transport failures, 5xx/429 answers and, with
+ * breaker_slow_ms set, slow answers count as failures. Once enough of them
+ * failed, the breaker opens and queries fail with
+ * METEOSWISS_ERROR_CIRCUIT_OPEN without any request. After breaker_open_ms,
+ * the next query is sent as a probe: its success closes the breaker, its
+ * failure opens it again.
+ *
+ * @param client The client context.
+ * @return The current state, METEOSWISS_CIRCUIT_CLOSED when the breaker is disabled.
+ */
+MeteoSwissCircuitState meteoswiss_client_circuit_state(meteoswiss_client_t *client);
+
+/**
+ * @brief Fetches and parses weather data in a given lane of the rate limiter.
+ *
+ * Same as meteoswiss_client_query_ex(), which uses the interactive lane. With
+ * a rate_limit configured, every request sent upstream, including retries,
+ * takes a token from the bucket of the client. Interactive queries get the
+ * tokens first; background ones wait while any interactive query does. An
+ * interactive query joining the fetch of a background one for the same postal
+ * code moves that fetch to the interactive lane. A query that cannot get a
+ * token before its timeout fails immediately with METEOSWISS_ERROR_RATE_LIMITED
+ * rather than waiting in vain.
+ *
+ * @param client The client context.
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param priority The lane of the query.
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param timeout_ms The query timeout in milliseconds, including the wait for the rate limiter, 0 for none.
+ * @param stats Optional structure receiving the query details, may be NULL.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_client_query_priority(meteoswiss_client_t *client, int postal_code, MeteoSwissPriority priority,
+                                     MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Fetches and parses weather data into the arrays of a previous result.
+ *
+ * Same as meteoswiss_client_query_priority(), but for pollers that query
+ * again and again: the arrays already in data are reused, and only grow when
+ * a response has more entries than they hold. Once they are large enough,
+ * queries allocate no memory. An array may stay allocated while its count is
+ * 0. On failure, the content of data is undefined but its arrays are kept, so
+ * data can still be passed to the next call or to meteoswiss_data_free().
+ *
+ * @param client The client context.
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param priority The lane of the query.
+ * @param data Zeroed before the first call, then the result of the previous call.
+ * @param timeout_ms The query timeout in milliseconds, including the wait for the rate limiter, 0 for none.
+ * @param stats Optional structure receiving the query details, may be NULL.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_client_query_into(meteoswiss_client_t *client, int postal_code, MeteoSwissPriority priority,
+                                 MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Fetches and parses weather data for many postal codes using a client context.
+ *
+ * Same as meteoswiss_query_batch(), but the connections are kept in the client
+ * and reused by the next batch. Batches run in the background lane of the
+ * rate limiter: their requests are sent in groups as tokens become available.
+ * A group whose tokens do not come within timeout_ms is not sent, and the
+ * remaining postal codes fail with METEOSWISS_ERROR_RATE_LIMITED.
+ * With a circuit breaker, the breaker is checked before each group; once it
+ * opens, the remaining postal codes fail with METEOSWISS_ERROR_CIRCUIT_OPEN
+ * without any request.
+ *
+ * @param client The client context.
+ * @param postal_codes The postal codes to query.
+ * @param count The number of postal codes.
+ * @param data Array of count MeteoSwissData structures receiving the results.
+ * @param status Optional array of count status codes, one per postal code.
+ * @param max_in_flight The maximum number of concurrent requests, 0 for the default.
+ * @param timeout_ms The timeout of each request in milliseconds, 0 for none.
+ * @return 0 if every query succeeded, a negative MeteoSwissStatus otherwise.
+ */
+int meteoswiss_client_query_batch(meteoswiss_client_t *client, const int *postal_codes, size_t count,
+                                  MeteoSwissData *data, int *status, size_t max_in_flight, unsigned int timeout_ms);
+
+/**
+ * @brief Events of a socket, for event-loop integration.
+ */
+#define METEOSWISS_POLL_IN 0x1     ///< Readable
+#define METEOSWISS_POLL_OUT 0x2    ///< Writable
+#define METEOSWISS_POLL_ERROR 0x4  ///< In error, only passed to meteoswiss_async_socket_action()
+#define METEOSWISS_POLL_REMOVE 0x8 ///< No longer to be watched, only passed to the socket callback
+
+/**
+ * @brief Asynchronous client context driven by the event loop of the application.
+ */
+typedef struct meteoswiss_async meteoswiss_async_t;
+
+/**
+ * @brief Tells the application which events to watch on a socket.
+ *
+ * @param userp The user pointer given to meteoswiss_async_create().
+ * @param fd The socket.
+ * @param events METEOSWISS_POLL_IN and/or METEOSWISS_POLL_OUT to watch, or
+ *               METEOSWISS_POLL_REMOVE to stop watching the socket.
+ */
+typedef void (*meteoswiss_socket_callback)(void *userp, int fd, int events);
+
+/**
+ * @brief Tells the application when to call meteoswiss_async_timeout().
+ *
+ * @param userp The user pointer given to meteoswiss_async_create().
+ * @param timeout_ms The delay in milliseconds, 0 to call it as soon as
+ *                   possible, -1 to cancel the timer.
+ */
+typedef void (*meteoswiss_timer_callback)(void *userp, long timeout_ms);
+
+/**
+ * @brief Receives the result of an asynchronous query.
+ *
+ * @param userp The user pointer given to meteoswiss_async_query().
+ * @param postal_code The postal code of the query.
+ * @param status 0 on success, a negative MeteoSwissStatus on failure.
+ * @param data The result on success, to be freed with meteoswiss_data_free()
+ *             by the callback. NULL on failure.
+ * @param stats The query details, only valid until the callback returns.
+ */
+typedef void (*meteoswiss_query_callback)(void *userp, int postal_code, int status, MeteoSwissData *data,
+                                          const MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Creates an asynchronous client context.
+ *
+ * The context never blocks and never creates threads. It reports the sockets
+ * it needs through socket_callback and its timer through timer_callback, and
+ * only progresses when the application calls meteoswiss_async_socket_action()
+ * or meteoswiss_async_timeout() from its event loop (epoll, libuv, ...).
+ *
+ * The configuration is the same as for meteoswiss_client_create(), except that
+ * queries are made directly over HTTP: the transport, retries and hedging are
+ * ignored, and so is the rate limiter, which would have to block. Conditional
+ * requests and streaming_parse are supported.
+ *
+ * A context must only be used from the thread running the event loop. It is
+ * not available on ESP32.
+ *
+ * @param config The configuration, NULL for the defaults.
+ * @param socket_callback Called when a socket must be watched or forgotten.
+ * @param timer_callback Called when the timer must be armed or cancelled.
+ * @param userp User pointer passed to both callbacks.
+ * @return A new context, or NULL on failure.
+ */
+meteoswiss_async_t *meteoswiss_async_create(const MeteoSwissClientConfig *config,
+                                            meteoswiss_socket_callback socket_callback,
+                                            meteoswiss_timer_callback timer_callback, void *userp);
+
+/**
+ * @brief Destroys an asynchronous client context.
+ *
+ * The queries still in progress complete with METEOSWISS_ERROR. Queries
+ * started from their callbacks meanwhile fail to start.
+ *
+ * @param async The context to destroy, may be NULL.
+ */
+void meteoswiss_async_destroy(meteoswiss_async_t *async);
+
+/**
+ * @brief Starts fetching weather data for a given postal code.
+ *
+ * The query starts on the next meteoswiss_async_timeout() call requested
+ * through the timer callback. The callback is called exactly once, from
+ * meteoswiss_async_socket_action(), meteoswiss_async_timeout() or
+ * meteoswiss_async_destroy(), and may start new queries.
+ *
+ * @param async The context.
+ * @param postal_code The postal code to query (e.g., 1201 for Geneva).
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @param callback Receives the result.
+ * @param userp User pointer passed to the callback.
+ * @return 0 if the query started, a negative MeteoSwissStatus otherwise, in
+ *         which case the callback is not called.
+ */
+int meteoswiss_async_query(meteoswiss_async_t *async, int postal_code, unsigned int timeout_ms,
+                           meteoswiss_query_callback callback, void *userp);
+
+/**
+ * @brief Progresses the queries using a socket reported by the socket callback.
+ *
+ * @param async The context.
+ * @param fd The socket that became ready.
+ * @param events The METEOSWISS_POLL_* events that occurred.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_async_socket_action(meteoswiss_async_t *async, int fd, int events);
+
+/**
+ * @brief Progresses the queries once the timer requested by the timer callback expired.
+ *
+ * @param async The context.
+ * @return 0 on success, a negative MeteoSwissStatus on failure.
+ */
+int meteoswiss_async_timeout(meteoswiss_async_t *async);
+
+/**
+ * @brief Returns the number of queries in progress.
+ *
+ * @param async The context.
+ * @return The number of queries whose callback was not called yet.
+ */
+size_t meteoswiss_async_running(const meteoswiss_async_t *async);
+
 /**
  * @brief Frees allocated memory in MeteoSwissData.
  *
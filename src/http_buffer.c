@@ -0,0 +1,144 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "http_client.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HTTP_BUFFER_INITIAL_CAPACITY 16384
+
+void http_buffer_init(HttpBuffer *buffer, size_t max_size)
+{
+    memset(buffer, 0, sizeof(HttpBuffer));
+    buffer->max_size = max_size;
+}
+
+void http_buffer_reset(HttpBuffer *buffer)
+{
+    buffer->length = 0;
+    buffer->overflow = 0;
+    if (buffer->data)
+    {
+        buffer->data[0] = '\0';
+    }
+}
+
+int http_buffer_reserve(HttpBuffer *buffer, size_t size)
+{
+    // One extra byte for the null-terminator
+    if (size < buffer->capacity)
+    {
+        return 0;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : HTTP_BUFFER_INITIAL_CAPACITY;
+    while (capacity <= size)
+    {
+        capacity *= 2;
+    }
+
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL)
+    {
+        return -1;
+    }
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+int http_buffer_append(HttpBuffer *buffer, const void *data, size_t size)
+{
+    if (buffer->max_size && size > buffer->max_size - buffer->length)
+    {
+        buffer->overflow = 1;
+        return -1;
+    }
+
+    if (buffer->sink)
+    {
+        if (buffer->sink(buffer->sink_userp, data, size) != 0)
+        {
+            return -1;
+        }
+        buffer->length += size;
+        return 0;
+    }
+
+    if (http_buffer_reserve(buffer, buffer->length + size) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(buffer->data + buffer->length, data, size);
+    buffer->length += size;
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+void http_buffer_free(HttpBuffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+void http_response_init(HttpResponse *response, size_t max_size)
+{
+    http_buffer_init(&response->body, max_size);
+    response->status_code = 0;
+    response->etag[0] = '\0';
+    response->last_modified[0] = '\0';
+    memset(&response->timings, 0, sizeof(HttpTimings));
+}
+
+void http_response_reset(HttpResponse *response)
+{
+    http_buffer_reset(&response->body);
+    response->status_code = 0;
+    response->etag[0] = '\0';
+    response->last_modified[0] = '\0';
+    memset(&response->timings, 0, sizeof(HttpTimings));
+}
+
+void http_response_start(HttpResponse *response, const HttpRequest *request)
+{
+    http_response_reset(response);
+    response->body.sink = request->sink;
+    response->body.sink_userp = request->sink_userp;
+
+    // Best effort, the buffer still grows on demand if this fails
+    size_t hint = request->size_hint;
+    if (request->sink == NULL && hint > 0)
+    {
+        if (response->body.max_size && hint > response->body.max_size)
+        {
+            hint = response->body.max_size;
+        }
+        http_buffer_reserve(&response->body, hint);
+    }
+}
+
+void http_response_free(HttpResponse *response)
+{
+    http_buffer_free(&response->body);
+}
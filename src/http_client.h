@@ -21,21 +21,386 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
+#include "meteoswiss.h"
 #include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Consumes a response body chunk by chunk as it is received.
+ *
+ * @param userp The user pointer of the sink.
+ * @param data The chunk.
+ * @param size The size of the chunk.
+ * @return 0 to continue, non-zero to abort the transfer.
+ */
+typedef int (*http_sink)(void *userp, const char *data, size_t size);
+
+/**
+ * @brief Growable buffer receiving a response body.
+ *
+ * The write offset is tracked, so appending a chunk never rescans the data
+ * already received. The data is always null-terminated.
+ *
+ * When a sink is set, chunks are passed to it instead of being stored and only
+ * the length is tracked, so the body can be consumed while it downloads.
+ */
+typedef struct {
+    char *data;      // Response body, NULL until the first append
+    size_t length;   // Number of bytes written
+    size_t capacity; // Allocated size of data
+    size_t max_size; // Hard cap on the body size, 0 for no cap
+    int overflow;    // Set when an append would have exceeded max_size
+    http_sink sink;  // Receives the chunks instead of data when not NULL
+    void *sink_userp;
+} HttpBuffer;
+
+/**
+ * @brief Initialize an empty response buffer.
+ *
+ * @param buffer The buffer to initialize.
+ * @param max_size Hard cap on the body size, 0 for no cap.
+ */
+void http_buffer_init(HttpBuffer *buffer, size_t max_size);
+
+/**
+ * @brief Empty a response buffer, keeping its allocation for reuse.
+ *
+ * @param buffer The buffer to reset.
+ */
+void http_buffer_reset(HttpBuffer *buffer);
+
+/**
+ * @brief Make sure a response buffer can hold a body of the given size.
+ *
+ * @param buffer The buffer to grow.
+ * @param size The body size to hold, excluding the null-terminator.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int http_buffer_reserve(HttpBuffer *buffer, size_t size);
+
+/**
+ * @brief Append a chunk to a response buffer, in amortized constant time.
+ *
+ * @param buffer The buffer to append to.
+ * @param data The chunk to append.
+ * @param size The size of the chunk.
+ * @return 0 on success, non-zero if the cap is exceeded or allocation failed.
+ */
+int http_buffer_append(HttpBuffer *buffer, const void *data, size_t size);
+
+/**
+ * @brief Release the memory held by a response buffer.
+ *
+ * @param buffer The buffer to free.
+ */
+void http_buffer_free(HttpBuffer *buffer);
+
+/**
+ * @brief Maximum size of a cache validator header value, including the null-terminator.
+ */
+#define HTTP_VALIDATOR_SIZE 128
+
+/**
+ * @brief A GET request on a persistent HTTP client.
+ */
+typedef struct {
+    const char *url;
+    const char *if_none_match;     // Sent as If-None-Match when not NULL
+    const char *if_modified_since; // Sent as If-Modified-Since when not NULL
+    http_sink sink;                // Receives the body instead of the response buffer when not NULL
+    void *sink_userp;
+    size_t size_hint;              // Expected body size, allocated upfront, 0 if unknown
+    const char *resolve;           // "host:port:address[,address]..." pinning the host, NULL to resolve it
+} HttpRequest;
+
+/**
+ * @brief Duration of the phases of a request, in microseconds.
+ *
+ * Phases skipped on a reused connection are 0. Backends that cannot measure a
+ * phase leave it at 0.
+ */
+typedef struct {
+    long long dns_us;         // Name resolution
+    long long connect_us;     // TCP connect
+    long long tls_us;         // TLS handshake
+    long long wait_us;        // From the request being sent to the first response byte
+    long long transfer_us;    // From the first to the last response byte
+    long long total_us;       // Whole request
+    long long bytes_received; // Body bytes received on the wire, before decoding
+} HttpTimings;
+
+/**
+ * @brief The response to a GET request on a persistent HTTP client.
+ */
+typedef struct {
+    HttpBuffer body;
+    long status_code;                        // HTTP status, 304 when the cached copy is still valid
+    char etag[HTTP_VALIDATOR_SIZE];          // ETag header, empty if absent
+    char last_modified[HTTP_VALIDATOR_SIZE]; // Last-Modified header, empty if absent
+    HttpTimings timings;
+} HttpResponse;
+
+/**
+ * @brief Initialize an empty response.
+ *
+ * @param response The response to initialize.
+ * @param max_size Hard cap on the body size, 0 for no cap.
+ */
+void http_response_init(HttpResponse *response, size_t max_size);
+
+/**
+ * @brief Empty a response, keeping its body allocation for reuse.
+ *
+ * @param response The response to reset.
+ */
+void http_response_reset(HttpResponse *response);
+
+/**
+ * @brief Empty a response before performing a request into it.
+ *
+ * Attaches the sink of the request, or allocates the body for its size hint.
+ *
+ * @param response The response to prepare.
+ * @param request The request about to be performed.
+ */
+void http_response_start(HttpResponse *response, const HttpRequest *request);
+
+/**
+ * @brief Release the memory held by a response.
+ *
+ * @param response The response to free.
+ */
+void http_response_free(HttpResponse *response);
+
 /**
  * @brief Perform an HTTPS GET request.
  *
  * @param url The URL to request.
- * @param response Buffer to store the response.
- * @param max_response_size The maximum size of the response buffer.
- * @return 0 on success, non-zero on failure.
+ * @param response Buffer receiving the response body, emptied first.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @return METEOSWISS_SUCCESS on success,
+ *         METEOSWISS_ERROR_RESPONSE_TOO_LARGE if the body exceeds the buffer cap,
+ *         METEOSWISS_ERROR on any other failure.
+ */
+int https_get(const char *url, HttpBuffer *response, unsigned int timeout_ms);
+
+/**
+ * @brief Caches shared by HTTP clients living in different threads.
+ */
+typedef struct http_share http_share_t;
+
+/**
+ * @brief Create a thread-safe share holding the DNS and TLS session caches.
+ *
+ * @return The new share, or NULL on failure or if the backend has no support.
+ */
+http_share_t *http_share_create(void);
+
+/**
+ * @brief Destroy a share. Every client attached to it must be destroyed first.
+ *
+ * @param share The share, may be NULL.
+ */
+void http_share_destroy(http_share_t *share);
+
+/**
+ * @brief Write the TLS sessions cached in a share to a file.
+ *
+ * @param share The share.
+ * @param path The file, replaced atomically.
+ * @return METEOSWISS_SUCCESS, METEOSWISS_ERROR_UNSUPPORTED if the backend
+ *         cannot export sessions, METEOSWISS_ERROR otherwise.
+ */
+int http_share_save_tls_sessions(http_share_t *share, const char *path);
+
+/**
+ * @brief Add the TLS sessions of a file written by http_share_save_tls_sessions() to a share.
+ *
+ * @param share The share.
+ * @param path The file.
+ * @return METEOSWISS_SUCCESS, METEOSWISS_ERROR_UNSUPPORTED if the backend
+ *         cannot import sessions, METEOSWISS_ERROR otherwise.
+ */
+int http_share_load_tls_sessions(http_share_t *share, const char *path);
+
+/**
+ * @brief Persistent HTTP client, reused across requests.
+ */
+typedef struct http_client http_client_t;
+
+/**
+ * @brief Create a persistent HTTP client.
+ *
+ * @param config The client configuration.
+ * @param share The share to attach the client to, or NULL for private caches.
+ * @return The new HTTP client, or NULL on failure.
+ */
+http_client_t *http_client_create(const MeteoSwissClientConfig *config, http_share_t *share);
+
+/**
+ * @brief Destroy a persistent HTTP client and close its connections.
+ *
+ * @param client The HTTP client, may be NULL.
+ */
+void http_client_destroy(http_client_t *client);
+
+/**
+ * @brief Perform an HTTPS GET request on a persistent HTTP client.
+ *
+ * A 304 status is not an error, the caller checks response->status_code.
+ *
+ * @param client The HTTP client.
+ * @param request The request to perform.
+ * @param response Response receiving the status, validators and body, emptied first.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @return The same status codes as https_get().
+ */
+int http_client_get(http_client_t *client, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms);
+
+/**
+ * @brief Open the connection of a persistent HTTP client ahead of its first request.
+ *
+ * Sends a HEAD request, resolving the host and completing the TCP and TLS
+ * handshakes. The connection is kept open for the next request.
+ *
+ * @param client The HTTP client.
+ * @param url A URL on the host to connect to, its status does not matter.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @return METEOSWISS_SUCCESS if the server answered, METEOSWISS_ERROR otherwise.
+ */
+int http_client_warm(http_client_t *client, const char *url, unsigned int timeout_ms);
+
+/**
+ * @brief Perform an HTTPS GET request, hedged by a second identical request if the first one is slow.
+ *
+ * If no response arrived after hedge_delay_ms, the same request is sent again
+ * and the first successful transfer wins, the other one is aborted. Both
+ * transfers must be able to run at once, so a request sink is not supported.
+ *
+ * @param client The HTTP client.
+ * @param request The request to perform, without sink.
+ * @param response Response receiving the status, validators and body, emptied first.
+ * @param timeout_ms The timeout of the whole operation in milliseconds, 0 for none.
+ * @param hedge_delay_ms The delay before the second request is sent.
+ * @param hedged Optional flag set when the second request was sent.
+ * @return The same status codes as https_get().
+ */
+int http_client_get_hedged(http_client_t *client, const HttpRequest *request, HttpResponse *response,
+                           unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged);
+
+/**
+ * @brief Called when a transfer of a batch completes.
+ *
+ * @param userp The user pointer given to http_client_get_batch().
+ * @param index The index of the request in the batch.
+ * @param status The status of the transfer, as returned by https_get().
+ * @param response The response, NULL if the transfer could not start.
+ *                 Only valid until the callback returns.
+ */
+typedef void (*http_batch_callback)(void *userp, size_t index, int status, HttpResponse *response);
+
+/**
+ * @brief Perform many HTTPS GET requests concurrently on a persistent HTTP client.
+ *
+ * The callback is invoked once per request, in completion order, while the
+ * other transfers keep progressing.
+ *
+ * @param client The HTTP client.
+ * @param requests The requests to perform.
+ * @param count The number of requests.
+ * @param max_in_flight The maximum number of concurrent transfers.
+ * @param timeout_ms The timeout of each request in milliseconds, 0 for none.
+ * @param callback Called with the result of each transfer.
+ * @param userp User pointer passed to the callback.
+ * @return METEOSWISS_SUCCESS if every transfer succeeded, METEOSWISS_ERROR otherwise.
+ */
+int http_client_get_batch(http_client_t *client, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                          unsigned int timeout_ms, http_batch_callback callback, void *userp);
+
+/**
+ * @brief Requests driven by the event loop of the application.
+ *
+ * The engine never blocks and never spawns threads: it reports the sockets
+ * and the timeout it needs through callbacks, and progresses when the
+ * application calls http_async_socket_action() or http_async_timeout().
+ */
+typedef struct http_async http_async_t;
+
+/**
+ * @brief Called when an asynchronous request completes.
+ *
+ * @param userp The user pointer given to http_async_get().
+ * @param status The status of the transfer, as returned by https_get().
+ * @param response The response, NULL if the transfer was cancelled.
+ *                 Only valid until the callback returns.
+ */
+typedef void (*http_async_callback)(void *userp, int status, HttpResponse *response);
+
+/**
+ * @brief Create an asynchronous engine.
+ *
+ * @param config The client configuration.
+ * @param share The share to attach the transfers to, or NULL for private caches.
+ * @param socket_callback Told which sockets to watch, see meteoswiss_socket_callback.
+ * @param timer_callback Told when to call http_async_timeout(), see meteoswiss_timer_callback.
+ * @param userp User pointer passed to both callbacks.
+ * @return The new engine, or NULL on failure or if the backend has no support.
+ */
+http_async_t *http_async_create(const MeteoSwissClientConfig *config, http_share_t *share,
+                                meteoswiss_socket_callback socket_callback,
+                                meteoswiss_timer_callback timer_callback, void *userp);
+
+/**
+ * @brief Destroy an engine, completing the requests in progress with an error.
+ *
+ * Requests started from the callbacks during the destruction are refused.
+ *
+ * @param async The engine, may be NULL.
+ */
+void http_async_destroy(http_async_t *async);
+
+/**
+ * @brief Start an HTTPS GET request.
+ *
+ * @param async The engine.
+ * @param request The request, only used during the call.
+ * @param timeout_ms The request timeout in milliseconds, 0 for none.
+ * @param callback Called once with the result, from http_async_socket_action(),
+ *                 http_async_timeout() or http_async_destroy().
+ * @param userp User pointer passed to the callback.
+ * @return METEOSWISS_SUCCESS if the request started, METEOSWISS_ERROR otherwise.
+ */
+int http_async_get(http_async_t *async, const HttpRequest *request, unsigned int timeout_ms,
+                   http_async_callback callback, void *userp);
+
+/**
+ * @brief Progress the transfers using a socket that became ready.
+ *
+ * @param async The engine.
+ * @param fd The socket.
+ * @param events The METEOSWISS_POLL_* events that occurred.
+ * @return METEOSWISS_SUCCESS, or METEOSWISS_ERROR if the engine failed.
+ */
+int http_async_socket_action(http_async_t *async, int fd, int events);
+
+/**
+ * @brief Progress the transfers after the requested timeout expired.
+ *
+ * @param async The engine.
+ * @return METEOSWISS_SUCCESS, or METEOSWISS_ERROR if the engine failed.
+ */
+int http_async_timeout(http_async_t *async);
+
+/**
+ * @brief Number of requests in progress.
+ *
+ * @param async The engine.
+ * @return The number of requests whose callback was not called yet.
  */
-int https_get(const char *url, char *response, size_t max_response_size, unsigned int timeout);
+size_t http_async_running(const http_async_t *async);
 
 #ifdef __cplusplus
 }
@@ -23,57 +23,163 @@
 #include "http_client.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #include <curl/curl.h>
 
-static unsigned long int MAX_RESPONSE_SIZE;
+struct http_share
+{
+    CURLSH *curlsh;
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+};
+
+// Addresses pinned on a handle, kept until the handle starts another transfer
+typedef struct
+{
+    char *entry;
+    struct curl_slist *list;
+} ResolvePin;
+
+// Easy handle of a batch transfer, reused for the next URL once it completes
+typedef struct
+{
+    CURL *curl;
+    HttpResponse response;
+    struct curl_slist *headers;
+    ResolvePin resolve;
+    size_t index;
+    int active;
+} BatchSlot;
+
+struct http_client
+{
+    MeteoSwissClientConfig config;
+    http_share_t *share;
+    CURL *curl;
+    ResolvePin resolve;
+
+    // Concurrent transfers, created on the first batch
+    CURLM *multi;
+    BatchSlot *slots;
+    size_t slot_count;
+};
 
 static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     size_t total_size = size * nmemb;
-    char *response = (char *)userp;
+    HttpBuffer *response = (HttpBuffer *)userp;
 
-    // Calculate the remaining buffer size
-    size_t current_length = strlen(response);
-    size_t remaining_space = MAX_RESPONSE_SIZE - current_length - 1; // -1 for null-terminator
+    // Returning less than total_size aborts the transfer with CURLE_WRITE_ERROR
+    if (http_buffer_append(response, contents, total_size) != 0)
+    {
+        return 0;
+    }
 
-    // Ensure we don't exceed the buffer size
-    if (total_size > remaining_space)
+    return total_size;
+}
+
+// Set the options of a single request on an easy handle
+static void setup_request(CURL *curl, const char *url, HttpBuffer *response, unsigned int timeout_ms)
+{
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout_ms);
+
+    // Reject oversized bodies up front when the server announces their length.
+    // With compression this is the encoded size, the decoded size is capped by
+    // write_callback.
+    curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)response->max_size);
+}
+
+static void resolve_pin_free(ResolvePin *pin)
+{
+    curl_slist_free_all(pin->list);
+    free(pin->entry);
+    pin->list = NULL;
+    pin->entry = NULL;
+}
+
+// Make a handle connect to the addresses pinned by a request, or resolve the host itself.
+// libcurl reads the list when the transfer starts, it is only rebuilt for another one.
+static int setup_resolve(CURL *curl, ResolvePin *pin, const char *entry)
+{
+    if (entry == NULL)
     {
-        total_size = remaining_space;
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, NULL);
+        return 0;
     }
 
-    // Append the contents to the response buffer
-    strncat(response, (char *)contents, total_size);
+    if (pin->entry == NULL || strcmp(pin->entry, entry) != 0)
+    {
+        resolve_pin_free(pin);
 
-    // Return the number of bytes actually written
-    return total_size;
+        // "-host:port" first drops the addresses pinned before, so a refresh replaces them
+        const char *port = strchr(entry, ':');
+        const char *addresses = port ? strchr(port + 1, ':') : NULL;
+        if (addresses == NULL)
+        {
+            return -1;
+        }
+        size_t removal_size = (size_t)(addresses - entry) + 2;
+        char *removal = malloc(removal_size);
+        pin->entry = strdup(entry);
+        if (removal && pin->entry)
+        {
+            snprintf(removal, removal_size, "-%.*s", (int)(addresses - entry), entry);
+            pin->list = curl_slist_append(NULL, removal);
+        }
+        struct curl_slist *list = pin->list ? curl_slist_append(pin->list, entry) : NULL;
+        free(removal);
+        if (list == NULL)
+        {
+            resolve_pin_free(pin);
+            return -1;
+        }
+        pin->list = list;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, pin->list);
+    return 0;
 }
 
-int https_get(const char *url, char *response, size_t max_response_size, unsigned int timeout_ms)
+// Map the result of a transfer to a MeteoSwissStatus
+static int transfer_status(CURLcode res, const HttpBuffer *response)
+{
+    if (res == CURLE_OK)
+    {
+        return METEOSWISS_SUCCESS;
+    }
+    if (res == CURLE_FILESIZE_EXCEEDED || (res == CURLE_WRITE_ERROR && response->overflow))
+    {
+        return METEOSWISS_ERROR_RESPONSE_TOO_LARGE;
+    }
+    return METEOSWISS_ERROR;
+}
+
+int https_get(const char *url, HttpBuffer *response, unsigned int timeout_ms)
 {
     CURL *curl;
     CURLcode res;
 
-    // Initialize response buffer
-    if (response == NULL || max_response_size == 0)
+    if (response == NULL)
     {
-        return -1;
+        return METEOSWISS_ERROR;
     }
-    response[0] = '\0';                    // Ensure null-termination
-    MAX_RESPONSE_SIZE = max_response_size; // Set buffer size globally if necessary
+    http_buffer_reset(response);
 
     curl = curl_easy_init();
     if (!curl)
     {
-        return -1;
+        return METEOSWISS_ERROR;
     }
 
     // Set CURL options
-    curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-    if (timeout_ms)
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    setup_request(curl, url, response, timeout_ms);
 
     // Skip SSL verification
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
@@ -85,12 +191,1120 @@ int https_get(const char *url, char *response, size_t max_response_size, unsigne
     // Clean up
     curl_easy_cleanup(curl);
 
-    if (res != CURLE_OK)
+    return transfer_status(res, response);
+}
+
+static void share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userp)
+{
+    http_share_t *share = (http_share_t *)userp;
+    pthread_mutex_lock(&share->locks[data]);
+}
+
+static void share_unlock(CURL *curl, curl_lock_data data, void *userp)
+{
+    http_share_t *share = (http_share_t *)userp;
+    pthread_mutex_unlock(&share->locks[data]);
+}
+
+http_share_t *http_share_create(void)
+{
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        return NULL;
+    }
+
+    http_share_t *share = calloc(1, sizeof(http_share_t));
+    if (share == NULL)
+    {
+        curl_global_cleanup();
+        return NULL;
+    }
+
+    share->curlsh = curl_share_init();
+    if (share->curlsh == NULL)
+    {
+        free(share);
+        curl_global_cleanup();
+        return NULL;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    {
+        pthread_mutex_init(&share->locks[i], NULL);
+    }
+
+    curl_share_setopt(share->curlsh, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share->curlsh, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share->curlsh, CURLSHOPT_USERDATA, share);
+
+    // The connection cache is not shared, libcurl does not support using
+    // shared connections from several threads at once
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    return share;
+}
+
+void http_share_destroy(http_share_t *share)
+{
+    if (share == NULL)
+    {
+        return;
+    }
+
+    curl_share_cleanup(share->curlsh);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    {
+        pthread_mutex_destroy(&share->locks[i]);
+    }
+    free(share);
+    curl_global_cleanup();
+}
+
+// Set the options shared by every easy handle of a persistent client
+static void configure_handle(CURL *curl, const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    // Keep the connection alive between requests
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, config->keepalive_idle_s);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, config->keepalive_interval_s);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, config->max_idle_s);
+
+    // Resume the TLS session when a new connection has to be opened
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+
+    // Skip SSL verification
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+
+    if (config->compression)
+    {
+        // Offer every encoding libcurl was built with, the body is decoded
+        // chunk by chunk before it reaches write_callback
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    }
+
+    if (config->http2)
+    {
+        // Negotiate h2 through ALPN, and wait for a connection being set up
+        // to confirm multiplexing instead of opening one per transfer
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+
+    // Fail fast on a connection that cannot be established or stalls,
+    // instead of waiting for the whole request timeout
+    if (config->connect_timeout_ms > 0)
+    {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, config->connect_timeout_ms);
+    }
+    if (config->low_speed_limit > 0 && config->low_speed_time_s > 0)
+    {
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, config->low_speed_limit);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, config->low_speed_time_s);
+    }
+
+    if (config->unix_socket_path)
+    {
+        curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, config->unix_socket_path);
+    }
+
+    if (share)
+    {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share->curlsh);
+    }
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+
+// Header of a TLS sessions file, then for each session: its expiry as an
+// int64_t, the lengths of its salted hash and data as uint32_t, and both blobs
+#define TLS_SESSIONS_MAGIC "MeteoSwissTLS1\n"
+
+// Bound on the salted hash and data of a session together, real ones take a few kB
+#define TLS_SESSION_MAX_SIZE (64 * 1024)
+
+static CURLcode export_session(CURL *curl, void *userp, const char *session_key, const unsigned char *shmac,
+                               size_t shmac_len, const unsigned char *sdata, size_t sdata_len, curl_off_t valid_until,
+                               int ietf_tls_id, const char *alpn, size_t earlydata_max)
+{
+    FILE *file = (FILE *)userp;
+    // Only sessions with a salted hash can be imported by another process, and
+    // only the ones within the bound of the loader
+    if (shmac == NULL || shmac_len == 0 || shmac_len > TLS_SESSION_MAX_SIZE ||
+        sdata_len > TLS_SESSION_MAX_SIZE - shmac_len)
+    {
+        return CURLE_OK;
+    }
+
+    int64_t expiry = (int64_t)valid_until;
+    uint32_t lengths[2] = {(uint32_t)shmac_len, (uint32_t)sdata_len};
+    if (fwrite(&expiry, sizeof(expiry), 1, file) != 1 || fwrite(lengths, sizeof(lengths), 1, file) != 1 ||
+        fwrite(shmac, 1, shmac_len, file) != shmac_len || fwrite(sdata, 1, sdata_len, file) != sdata_len)
+    {
+        return CURLE_WRITE_ERROR;
+    }
+    return CURLE_OK;
+}
+
+int http_share_save_tls_sessions(http_share_t *share, const char *path)
+{
+    if (share == NULL || path == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    // Sessions are exported through an easy handle attached to the share
+    CURL *curl = curl_easy_init();
+    if (curl == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, share->curlsh);
+
+    // A unique temporary file next to the target, created private and never
+    // through an existing path, so concurrent savers do not clobber each other
+    size_t temporary_size = strlen(path) + sizeof(".XXXXXX");
+    char *temporary = malloc(temporary_size);
+    FILE *file = NULL;
+    if (temporary)
+    {
+        snprintf(temporary, temporary_size, "%s.XXXXXX", path);
+        int fd = mkstemp(temporary);
+        if (fd >= 0)
+        {
+            file = fdopen(fd, "wb");
+            if (file == NULL)
+            {
+                close(fd);
+                remove(temporary);
+            }
+        }
+    }
+
+    int status = METEOSWISS_ERROR;
+    if (file)
+    {
+        CURLcode res = CURLE_WRITE_ERROR;
+        if (fwrite(TLS_SESSIONS_MAGIC, 1, sizeof(TLS_SESSIONS_MAGIC) - 1, file) == sizeof(TLS_SESSIONS_MAGIC) - 1)
+        {
+            res = curl_easy_ssls_export(curl, export_session, file);
+        }
+        if (fclose(file) == 0 && res == CURLE_OK && rename(temporary, path) == 0)
+        {
+            status = METEOSWISS_SUCCESS;
+        }
+        else
+        {
+            remove(temporary);
+            status = (res == CURLE_NOT_BUILT_IN) ? METEOSWISS_ERROR_UNSUPPORTED : METEOSWISS_ERROR;
+        }
+    }
+
+    free(temporary);
+    curl_easy_cleanup(curl);
+    return status;
+}
+
+int http_share_load_tls_sessions(http_share_t *share, const char *path)
+{
+    if (share == NULL || path == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    char magic[sizeof(TLS_SESSIONS_MAGIC) - 1];
+    CURL *curl = NULL;
+    int status = METEOSWISS_ERROR;
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, TLS_SESSIONS_MAGIC, sizeof(magic)) == 0)
+    {
+        curl = curl_easy_init();
+    }
+    if (curl)
+    {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share->curlsh);
+        status = METEOSWISS_SUCCESS;
+    }
+
+    unsigned char *blob = NULL;
+    size_t blob_size = 0;
+    int64_t expiry;
+    uint32_t lengths[2];
+    while (status == METEOSWISS_SUCCESS && fread(&expiry, sizeof(expiry), 1, file) == 1)
+    {
+        // Lengths no saver writes mean the file is corrupt, nothing is allocated for them
+        if (fread(lengths, sizeof(lengths), 1, file) != 1 || lengths[0] == 0 || lengths[0] > TLS_SESSION_MAX_SIZE ||
+            lengths[1] > TLS_SESSION_MAX_SIZE - lengths[0])
+        {
+            status = METEOSWISS_ERROR;
+            break;
+        }
+
+        size_t size = (size_t)lengths[0] + lengths[1];
+        if (size > blob_size)
+        {
+            unsigned char *grown = realloc(blob, size);
+            if (grown == NULL)
+            {
+                status = METEOSWISS_ERROR;
+                break;
+            }
+            blob = grown;
+            blob_size = size;
+        }
+        if (fread(blob, 1, size, file) != size)
+        {
+            status = METEOSWISS_ERROR;
+            break;
+        }
+
+        if (expiry > (int64_t)time(NULL))
+        {
+            CURLcode res = curl_easy_ssls_import(curl, NULL, blob, lengths[0], blob + lengths[0], lengths[1]);
+            if (res == CURLE_NOT_BUILT_IN)
+            {
+                status = METEOSWISS_ERROR_UNSUPPORTED;
+            }
+            else if (res != CURLE_OK)
+            {
+                status = METEOSWISS_ERROR; // A session libcurl cannot make sense of, the file is corrupt
+            }
+        }
+    }
+
+    free(blob);
+    curl_easy_cleanup(curl);
+    fclose(file);
+    return status;
+}
+
+#else
+
+// Session export and import appeared in libcurl 8.12.0
+int http_share_save_tls_sessions(http_share_t *share, const char *path)
+{
+    return METEOSWISS_ERROR_UNSUPPORTED;
+}
+
+int http_share_load_tls_sessions(http_share_t *share, const char *path)
+{
+    return METEOSWISS_ERROR_UNSUPPORTED;
+}
+
+#endif
+
+http_client_t *http_client_create(const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    if (config == NULL)
+    {
+        return NULL;
+    }
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        return NULL;
+    }
+
+    http_client_t *client = calloc(1, sizeof(http_client_t));
+    if (client == NULL)
+    {
+        curl_global_cleanup();
+        return NULL;
+    }
+    client->config = *config;
+    client->share = share;
+
+    client->curl = curl_easy_init();
+    if (!client->curl)
+    {
+        free(client);
+        curl_global_cleanup();
+        return NULL;
+    }
+    configure_handle(client->curl, config, share);
+
+    return client;
+}
+
+void http_client_destroy(http_client_t *client)
+{
+    if (client == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < client->slot_count; i++)
+    {
+        curl_easy_cleanup(client->slots[i].curl);
+        http_response_free(&client->slots[i].response);
+        resolve_pin_free(&client->slots[i].resolve);
+    }
+    free(client->slots);
+    if (client->multi)
+    {
+        curl_multi_cleanup(client->multi);
+    }
+
+    curl_easy_cleanup(client->curl);
+    resolve_pin_free(&client->resolve);
+    free(client);
+    curl_global_cleanup();
+}
+
+// Add the conditional headers of a request, the list is freed after the transfer
+static int setup_conditions(CURL *curl, const HttpRequest *request, struct curl_slist **headers)
+{
+    char header[HTTP_VALIDATOR_SIZE + 32];
+    struct curl_slist *list = NULL;
+
+    if (request->if_none_match)
+    {
+        snprintf(header, sizeof(header), "If-None-Match: %s", request->if_none_match);
+        list = curl_slist_append(list, header);
+        if (list == NULL)
+        {
+            return -1;
+        }
+    }
+    if (request->if_modified_since)
+    {
+        snprintf(header, sizeof(header), "If-Modified-Since: %s", request->if_modified_since);
+        struct curl_slist *appended = curl_slist_append(list, header);
+        if (appended == NULL)
+        {
+            curl_slist_free_all(list);
+            return -1;
+        }
+        list = appended;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+    *headers = list;
+    return 0;
+}
+
+static void copy_header(CURL *curl, const char *name, char *value, size_t value_size)
+{
+    struct curl_header *header;
+    if (curl_easy_header(curl, name, 0, CURLH_HEADER, -1, &header) == CURLHE_OK)
+    {
+        snprintf(value, value_size, "%s", header->value);
+    }
+}
+
+// Turn the cumulative times reported by libcurl into the duration of each phase
+static void read_timings(CURL *curl, HttpTimings *timings)
+{
+    curl_off_t namelookup = 0, connect = 0, appconnect = 0, pretransfer = 0, starttransfer = 0, total = 0;
+    curl_off_t size = 0;
+
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+
+    // A phase that did not happen is reported as 0 rather than as the time of the previous one
+    timings->dns_us = namelookup;
+    timings->connect_us = (connect > namelookup) ? connect - namelookup : 0;
+    timings->tls_us = (appconnect > connect) ? appconnect - connect : 0;
+    timings->wait_us = (starttransfer > pretransfer) ? starttransfer - pretransfer : 0;
+    timings->transfer_us = (total > starttransfer && starttransfer > 0) ? total - starttransfer : 0;
+    timings->total_us = total;
+    timings->bytes_received = size;
+}
+
+// Fill the status, the cache validators and the timings of a completed transfer
+static void read_response_info(CURL *curl, HttpResponse *response)
+{
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response->status_code);
+    copy_header(curl, "ETag", response->etag, sizeof(response->etag));
+    copy_header(curl, "Last-Modified", response->last_modified, sizeof(response->last_modified));
+    read_timings(curl, &response->timings);
+}
+
+int http_client_get(http_client_t *client, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    if (client == NULL || request == NULL || response == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+    http_response_start(response, request);
+
+    struct curl_slist *headers;
+    if (setup_conditions(client->curl, request, &headers) != 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+    setup_request(client->curl, request->url, &response->body, timeout_ms);
+    if (setup_resolve(client->curl, &client->resolve, request->resolve) != 0)
+    {
+        curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, NULL);
+        curl_slist_free_all(headers);
+        return METEOSWISS_ERROR;
+    }
+
+    CURLcode res = curl_easy_perform(client->curl);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(headers);
+
+    read_response_info(client->curl, response);
+    return transfer_status(res, &response->body);
+}
+
+int http_client_warm(http_client_t *client, const char *url, unsigned int timeout_ms)
+{
+    if (client == NULL || url == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    HttpBuffer body;
+    http_buffer_init(&body, 0);
+    setup_request(client->curl, url, &body, timeout_ms);
+    curl_easy_setopt(client->curl, CURLOPT_NOBODY, 1L);
+
+    CURLcode res = curl_easy_perform(client->curl);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPGET, 1L);
+    http_buffer_free(&body);
+
+    return (res == CURLE_OK) ? METEOSWISS_SUCCESS : METEOSWISS_ERROR;
+}
+
+// Make sure the client has a multi handle and at least slot_count batch slots
+static int prepare_batch(http_client_t *client, size_t slot_count)
+{
+    if (client->multi == NULL)
+    {
+        client->multi = curl_multi_init();
+        if (client->multi == NULL)
+        {
+            return -1;
+        }
+
+        if (client->config.http2)
+        {
+            curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+            if (client->config.max_concurrent_streams > 0)
+            {
+                curl_multi_setopt(client->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, client->config.max_concurrent_streams);
+            }
+        }
+    }
+
+    if (slot_count <= client->slot_count)
+    {
+        return 0;
+    }
+
+    BatchSlot *slots = realloc(client->slots, slot_count * sizeof(BatchSlot));
+    if (slots == NULL)
     {
         return -1;
     }
+    client->slots = slots;
+
+    // The slots moved, their handles must point to the new location
+    for (size_t i = 0; i < client->slot_count; i++)
+    {
+        curl_easy_setopt(slots[i].curl, CURLOPT_PRIVATE, &slots[i]);
+    }
 
+    while (client->slot_count < slot_count)
+    {
+        BatchSlot *slot = &client->slots[client->slot_count];
+        slot->curl = curl_easy_init();
+        if (slot->curl == NULL)
+        {
+            return -1;
+        }
+        configure_handle(slot->curl, &client->config, client->share);
+        curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, slot);
+        http_response_init(&slot->response, client->config.max_response_size);
+        slot->headers = NULL;
+        slot->resolve.entry = NULL;
+        slot->resolve.list = NULL;
+        slot->active = 0;
+        client->slot_count++;
+    }
+
+    // Keep one idle connection per slot in the cache for the next batch
+    curl_multi_setopt(client->multi, CURLMOPT_MAXCONNECTS, (long)client->slot_count);
+    return 0;
+}
+
+// Release the per-request state of a slot
+static void finish_transfer(BatchSlot *slot)
+{
+    curl_easy_setopt(slot->curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(slot->headers);
+    slot->headers = NULL;
+    slot->active = 0;
+}
+
+// Start a request on a free slot
+static int start_transfer(http_client_t *client, BatchSlot *slot, const HttpRequest *request, size_t index, unsigned int timeout_ms)
+{
+    slot->index = index;
+    http_response_start(&slot->response, request);
+    if (setup_conditions(slot->curl, request, &slot->headers) != 0)
+    {
+        return -1;
+    }
+    setup_request(slot->curl, request->url, &slot->response.body, timeout_ms);
+    if (setup_resolve(slot->curl, &slot->resolve, request->resolve) != 0)
+    {
+        finish_transfer(slot);
+        return -1;
+    }
+
+    if (curl_multi_add_handle(client->multi, slot->curl) != CURLM_OK)
+    {
+        finish_transfer(slot);
+        return -1;
+    }
+    slot->active = 1;
     return 0;
 }
 
+static long long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+int http_client_get_hedged(http_client_t *client, const HttpRequest *request, HttpResponse *response,
+                           unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    if (hedged)
+    {
+        *hedged = 0;
+    }
+    if (client == NULL || request == NULL || response == NULL || request->sink)
+    {
+        return METEOSWISS_ERROR;
+    }
+    http_response_reset(response);
+
+    if (prepare_batch(client, 2) != 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+    BatchSlot *slots = client->slots;
+    if (start_transfer(client, &slots[0], request, 0, timeout_ms) != 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    long long start_ms = monotonic_ms();
+    size_t running = 1;
+    int hedge_pending = 1;
+    int status = METEOSWISS_ERROR;
+    BatchSlot *completed = NULL;
+
+    while (running > 0)
+    {
+        int still_running;
+        if (curl_multi_perform(client->multi, &still_running) != CURLM_OK)
+        {
+            break;
+        }
+
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(client->multi, &queued)) != NULL)
+        {
+            if (msg->msg != CURLMSG_DONE)
+            {
+                continue;
+            }
+
+            BatchSlot *slot;
+            CURLcode res = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+            curl_multi_remove_handle(client->multi, slot->curl);
+            finish_transfer(slot);
+            read_response_info(slot->curl, &slot->response);
+            running--;
+
+            completed = slot;
+            status = transfer_status(res, &slot->response.body);
+            if (status == METEOSWISS_SUCCESS)
+            {
+                break;
+            }
+        }
+
+        // The first success wins, a failure waits for the other transfer if there is one
+        if (status == METEOSWISS_SUCCESS || running == 0)
+        {
+            break;
+        }
+
+        long long elapsed_ms = monotonic_ms() - start_ms;
+        int wait_ms = 1000;
+        if (hedge_pending)
+        {
+            if (elapsed_ms >= hedge_delay_ms)
+            {
+                hedge_pending = 0;
+                if (timeout_ms == 0 || elapsed_ms < timeout_ms)
+                {
+                    unsigned int remaining_ms = timeout_ms ? timeout_ms - (unsigned int)elapsed_ms : 0;
+                    if (start_transfer(client, &slots[1], request, 1, remaining_ms) == 0)
+                    {
+                        running++;
+                        if (hedged)
+                        {
+                            *hedged = 1;
+                        }
+                    }
+                }
+            }
+            else if (hedge_delay_ms - elapsed_ms < wait_ms)
+            {
+                wait_ms = (int)(hedge_delay_ms - elapsed_ms);
+            }
+        }
+
+        if (curl_multi_poll(client->multi, NULL, 0, wait_ms, NULL) != CURLM_OK)
+        {
+            break;
+        }
+    }
+
+    // Abort the transfer that lost the race
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (slots[i].active)
+        {
+            curl_multi_remove_handle(client->multi, slots[i].curl);
+            finish_transfer(&slots[i]);
+        }
+    }
+
+    // Hand over the response by swapping buffers, the slot keeps the caller's allocation
+    if (completed)
+    {
+        HttpResponse swap = *response;
+        *response = completed->response;
+        completed->response = swap;
+    }
+    return completed ? status : METEOSWISS_ERROR;
+}
+
+int http_client_get_batch(http_client_t *client, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                          unsigned int timeout_ms, http_batch_callback callback, void *userp)
+{
+    if (client == NULL || requests == NULL || callback == NULL || max_in_flight == 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    size_t slot_count = (count < max_in_flight) ? count : max_in_flight;
+    if (prepare_batch(client, slot_count) != 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    size_t next = 0;
+    size_t running = 0;
+    int status = METEOSWISS_SUCCESS;
+
+    // Fill every slot, the remaining requests are started as slots free up
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        if (start_transfer(client, &client->slots[i], &requests[next], next, timeout_ms) != 0)
+        {
+            callback(userp, next, METEOSWISS_ERROR, NULL);
+            status = METEOSWISS_ERROR;
+        }
+        else
+        {
+            running++;
+        }
+        next++;
+    }
+
+    while (running > 0)
+    {
+        int still_running;
+        if (curl_multi_perform(client->multi, &still_running) != CURLM_OK)
+        {
+            status = METEOSWISS_ERROR;
+            break;
+        }
+
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(client->multi, &queued)) != NULL)
+        {
+            if (msg->msg != CURLMSG_DONE)
+            {
+                continue;
+            }
+
+            BatchSlot *slot;
+            CURLcode res = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+            curl_multi_remove_handle(client->multi, slot->curl);
+            finish_transfer(slot);
+            read_response_info(slot->curl, &slot->response);
+            running--;
+
+            int result = transfer_status(res, &slot->response.body);
+            if (result != METEOSWISS_SUCCESS)
+            {
+                status = METEOSWISS_ERROR;
+            }
+            callback(userp, slot->index, result, &slot->response);
+
+            // Reuse the slot for the next pending request
+            while (next < count)
+            {
+                size_t index = next++;
+                if (start_transfer(client, slot, &requests[index], index, timeout_ms) == 0)
+                {
+                    running++;
+                    break;
+                }
+                callback(userp, index, METEOSWISS_ERROR, NULL);
+                status = METEOSWISS_ERROR;
+            }
+        }
+
+        if (running > 0 && curl_multi_poll(client->multi, NULL, 0, 1000, NULL) != CURLM_OK)
+        {
+            status = METEOSWISS_ERROR;
+            break;
+        }
+    }
+
+    // Transfers are only left over after a multi handle failure
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        BatchSlot *slot = &client->slots[i];
+        if (slot->active)
+        {
+            curl_multi_remove_handle(client->multi, slot->curl);
+            finish_transfer(slot);
+            callback(userp, slot->index, METEOSWISS_ERROR, NULL);
+        }
+    }
+    for (; next < count; next++)
+    {
+        callback(userp, next, METEOSWISS_ERROR, NULL);
+    }
+
+    return status;
+}
+
+// An asynchronous request, its handle is kept for reuse once it completes
+typedef struct AsyncTransfer
+{
+    CURL *curl;
+    HttpResponse response;
+    struct curl_slist *headers;
+    ResolvePin resolve;
+    http_async_callback callback;
+    void *userp;
+    int active;
+    struct AsyncTransfer *next; // Next of every transfer of the engine
+} AsyncTransfer;
+
+struct http_async
+{
+    MeteoSwissClientConfig config;
+    http_share_t *share;
+    CURLM *multi;
+    meteoswiss_socket_callback socket_callback;
+    meteoswiss_timer_callback timer_callback;
+    void *userp;
+    AsyncTransfer *transfers;
+    size_t running;
+    int destroying;               // Set by http_async_destroy(), new requests are refused
+};
+
+static int async_socket(CURL *curl, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+    http_async_t *async = (http_async_t *)userp;
+    int events = 0;
+
+    switch (what)
+    {
+    case CURL_POLL_IN:
+        events = METEOSWISS_POLL_IN;
+        break;
+    case CURL_POLL_OUT:
+        events = METEOSWISS_POLL_OUT;
+        break;
+    case CURL_POLL_INOUT:
+        events = METEOSWISS_POLL_IN | METEOSWISS_POLL_OUT;
+        break;
+    case CURL_POLL_REMOVE:
+        events = METEOSWISS_POLL_REMOVE;
+        break;
+    default:
+        return 0;
+    }
+
+    async->socket_callback(async->userp, (int)fd, events);
+    return 0;
+}
+
+static int async_timer(CURLM *multi, long timeout_ms, void *userp)
+{
+    http_async_t *async = (http_async_t *)userp;
+    async->timer_callback(async->userp, timeout_ms);
+    return 0;
+}
+
+http_async_t *http_async_create(const MeteoSwissClientConfig *config, http_share_t *share,
+                                meteoswiss_socket_callback socket_callback,
+                                meteoswiss_timer_callback timer_callback, void *userp)
+{
+    if (config == NULL || socket_callback == NULL || timer_callback == NULL)
+    {
+        return NULL;
+    }
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        return NULL;
+    }
+
+    http_async_t *async = calloc(1, sizeof(http_async_t));
+    if (async == NULL)
+    {
+        curl_global_cleanup();
+        return NULL;
+    }
+    async->config = *config;
+    async->share = share;
+    async->socket_callback = socket_callback;
+    async->timer_callback = timer_callback;
+    async->userp = userp;
+
+    async->multi = curl_multi_init();
+    if (async->multi == NULL)
+    {
+        free(async);
+        curl_global_cleanup();
+        return NULL;
+    }
+
+    curl_multi_setopt(async->multi, CURLMOPT_SOCKETFUNCTION, async_socket);
+    curl_multi_setopt(async->multi, CURLMOPT_SOCKETDATA, async);
+    curl_multi_setopt(async->multi, CURLMOPT_TIMERFUNCTION, async_timer);
+    curl_multi_setopt(async->multi, CURLMOPT_TIMERDATA, async);
+    if (config->http2)
+    {
+        curl_multi_setopt(async->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        if (config->max_concurrent_streams > 0)
+        {
+            curl_multi_setopt(async->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, config->max_concurrent_streams);
+        }
+    }
+
+    return async;
+}
+
+// Release the per-request state of a transfer and hand its result to the callback
+static void async_finish(http_async_t *async, AsyncTransfer *transfer, int status, HttpResponse *response)
+{
+    curl_multi_remove_handle(async->multi, transfer->curl);
+    curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+    transfer->active = 0;
+    async->running--;
+
+    // The transfer is free again once the callback returns, it may start a new request
+    transfer->callback(transfer->userp, status, response);
+}
+
+void http_async_destroy(http_async_t *async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+
+    // The callbacks may try to start new requests, they must not reuse the transfers freed below
+    async->destroying = 1;
+    for (AsyncTransfer *transfer = async->transfers; transfer; transfer = transfer->next)
+    {
+        if (transfer->active)
+        {
+            async_finish(async, transfer, METEOSWISS_ERROR, NULL);
+        }
+    }
+
+    while (async->transfers)
+    {
+        AsyncTransfer *transfer = async->transfers;
+        async->transfers = transfer->next;
+        curl_easy_cleanup(transfer->curl);
+        http_response_free(&transfer->response);
+        resolve_pin_free(&transfer->resolve);
+        free(transfer);
+    }
+
+    curl_multi_cleanup(async->multi);
+    free(async);
+    curl_global_cleanup();
+}
+
+// Find an idle transfer, or create one
+static AsyncTransfer *async_transfer(http_async_t *async)
+{
+    for (AsyncTransfer *transfer = async->transfers; transfer; transfer = transfer->next)
+    {
+        if (!transfer->active)
+        {
+            return transfer;
+        }
+    }
+
+    AsyncTransfer *transfer = calloc(1, sizeof(AsyncTransfer));
+    if (transfer == NULL)
+    {
+        return NULL;
+    }
+    transfer->curl = curl_easy_init();
+    if (transfer->curl == NULL)
+    {
+        free(transfer);
+        return NULL;
+    }
+    configure_handle(transfer->curl, &async->config, async->share);
+    curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+    http_response_init(&transfer->response, async->config.max_response_size);
+
+    transfer->next = async->transfers;
+    async->transfers = transfer;
+    return transfer;
+}
+
+int http_async_get(http_async_t *async, const HttpRequest *request, unsigned int timeout_ms,
+                   http_async_callback callback, void *userp)
+{
+    if (async == NULL || request == NULL || callback == NULL || async->destroying)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    AsyncTransfer *transfer = async_transfer(async);
+    if (transfer == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    http_response_start(&transfer->response, request);
+    if (setup_conditions(transfer->curl, request, &transfer->headers) != 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+    setup_request(transfer->curl, request->url, &transfer->response.body, timeout_ms);
+    if (setup_resolve(transfer->curl, &transfer->resolve, request->resolve) != 0)
+    {
+        curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, NULL);
+        curl_slist_free_all(transfer->headers);
+        transfer->headers = NULL;
+        return METEOSWISS_ERROR;
+    }
+    transfer->callback = callback;
+    transfer->userp = userp;
+
+    // libcurl reports the first timeout through the timer callback, the
+    // request starts when the application calls http_async_timeout()
+    if (curl_multi_add_handle(async->multi, transfer->curl) != CURLM_OK)
+    {
+        curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, NULL);
+        curl_slist_free_all(transfer->headers);
+        transfer->headers = NULL;
+        return METEOSWISS_ERROR;
+    }
+    transfer->active = 1;
+    async->running++;
+    return METEOSWISS_SUCCESS;
+}
+
+// Hand the completed transfers to their callbacks
+static void async_read_completions(http_async_t *async)
+{
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(async->multi, &queued)) != NULL)
+    {
+        if (msg->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+
+        AsyncTransfer *transfer;
+        CURLcode res = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&transfer);
+        read_response_info(transfer->curl, &transfer->response);
+        async_finish(async, transfer, transfer_status(res, &transfer->response.body), &transfer->response);
+    }
+}
+
+int http_async_socket_action(http_async_t *async, int fd, int events)
+{
+    if (async == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    int mask = 0;
+    if (events & METEOSWISS_POLL_IN)
+    {
+        mask |= CURL_CSELECT_IN;
+    }
+    if (events & METEOSWISS_POLL_OUT)
+    {
+        mask |= CURL_CSELECT_OUT;
+    }
+    if (events & METEOSWISS_POLL_ERROR)
+    {
+        mask |= CURL_CSELECT_ERR;
+    }
+
+    int still_running;
+    CURLMcode result = curl_multi_socket_action(async->multi, (curl_socket_t)fd, mask, &still_running);
+    async_read_completions(async);
+    return (result == CURLM_OK) ? METEOSWISS_SUCCESS : METEOSWISS_ERROR;
+}
+
+int http_async_timeout(http_async_t *async)
+{
+    if (async == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    int still_running;
+    CURLMcode result = curl_multi_socket_action(async->multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+    async_read_completions(async);
+    return (result == CURLM_OK) ? METEOSWISS_SUCCESS : METEOSWISS_ERROR;
+}
+
+size_t http_async_running(const http_async_t *async)
+{
+    return async ? async->running : 0;
+}
+
 #endif // HTTP_WRAPPER_DESKTOP
\ No newline at end of file
@@ -21,22 +21,30 @@
 #if HTTP_WRAPPER_ESP32==1
 
 #include "http_client.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #define TAG "HTTP_CLIENT"
 
-static char *resp_buffer = NULL;
-static size_t resp_buffer_len = 0;
+struct http_client
+{
+    esp_http_client_handle_t handle;
+    size_t max_response_size;
+};
 
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
+    HttpBuffer *response = (HttpBuffer *)evt->user_data;
+
     switch(evt->event_id) {
     case HTTP_EVENT_ON_DATA:
-        if (resp_buffer && evt->data_len < resp_buffer_len) {
-            memcpy(resp_buffer, evt->data, evt->data_len);
-            resp_buffer[evt->data_len] = '\0';
+        if (response && http_buffer_append(response, evt->data, evt->data_len) != 0) {
+            return ESP_FAIL;
         }
         break;
     default:
@@ -45,18 +53,30 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-int https_get(const char *url, char *response, size_t max_response_size, unsigned int timeout_ms)
+// Map the result of a transfer to a MeteoSwissStatus
+static int transfer_status(esp_err_t err, const HttpBuffer *response)
 {
-    if (response == NULL || max_response_size == 0) {
-        return -1;
+    if (response->overflow) {
+        return METEOSWISS_ERROR_RESPONSE_TOO_LARGE;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
+        return METEOSWISS_ERROR;
     }
+    return METEOSWISS_SUCCESS;
+}
 
-    resp_buffer = response;
-    resp_buffer_len = max_response_size;
+int https_get(const char *url, HttpBuffer *response, unsigned int timeout_ms)
+{
+    if (response == NULL) {
+        return METEOSWISS_ERROR;
+    }
+    http_buffer_reset(response);
 
     esp_http_client_config_t config = {
         .url = url,
         .event_handler = http_event_handler,
+        .user_data = response,
         // For simplicity, skip SSL certificate verification (not recommended for production)
         .cert_pem = NULL,
         .skip_cert_common_name_check = true,
@@ -65,24 +85,244 @@ int https_get(const char *url, char *response, size_t max_response_size, unsigne
     esp_http_client_handle_t client = esp_http_client_init(&config);
     if (client == NULL) {
         ESP_LOGE(TAG, "Failed to initialize HTTP client");
-        return -1;
+        return METEOSWISS_ERROR;
     }
     
     esp_err_t err = esp_http_client_set_timeout_ms(client, timeout_ms);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set HTTP timeout: %s", esp_err_to_name(err));
         esp_http_client_cleanup(client);
-        return -1;
+        return METEOSWISS_ERROR;
+    }
+
+    err = esp_http_client_perform(client);
+    esp_http_client_cleanup(client);
+
+    return transfer_status(err, response);
+}
+
+// Event handler of persistent clients, also collecting the cache validators
+static esp_err_t client_event_handler(esp_http_client_event_t *evt)
+{
+    HttpResponse *response = (HttpResponse *)evt->user_data;
+    if (response == NULL) {
+        return ESP_OK;
     }
 
-    esp_err_t err = esp_http_client_perform(client);
+    switch(evt->event_id) {
+    case HTTP_EVENT_ON_HEADER:
+        if (strcasecmp(evt->header_key, "ETag") == 0) {
+            snprintf(response->etag, sizeof(response->etag), "%s", evt->header_value);
+        } else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+            snprintf(response->last_modified, sizeof(response->last_modified), "%s", evt->header_value);
+        }
+        break;
+    case HTTP_EVENT_ON_DATA:
+        if (http_buffer_append(&response->body, evt->data, evt->data_len) != 0) {
+            return ESP_FAIL;
+        }
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+http_share_t *http_share_create(void)
+{
+    // A single connection per client, there is nothing worth sharing
+    return NULL;
+}
+
+void http_share_destroy(http_share_t *share)
+{
+}
+
+int http_share_save_tls_sessions(http_share_t *share, const char *path)
+{
+    return METEOSWISS_ERROR_UNSUPPORTED;
+}
+
+int http_share_load_tls_sessions(http_share_t *share, const char *path)
+{
+    return METEOSWISS_ERROR_UNSUPPORTED;
+}
+
+http_client_t *http_client_create(const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    if (config == NULL) {
+        return NULL;
+    }
+    if (config->unix_socket_path) {
+        ESP_LOGE(TAG, "Unix sockets are not supported");
+        return NULL;
+    }
+
+    http_client_t *client = calloc(1, sizeof(http_client_t));
+    if (client == NULL) {
+        return NULL;
+    }
+
+    esp_http_client_config_t esp_config = {
+        // Replaced on each request, the handle only needs a valid initial URL
+        .url = "https://app-prod-ws.meteoswiss-app.ch",
+        .event_handler = client_event_handler,
+        .cert_pem = NULL,
+        .skip_cert_common_name_check = true,
+        .keep_alive_enable = true,
+        .keep_alive_idle = (int)config->keepalive_idle_s,
+        .keep_alive_interval = (int)config->keepalive_interval_s,
+    };
+
+    client->max_response_size = config->max_response_size;
+    client->handle = esp_http_client_init(&esp_config);
+    if (client->handle == NULL) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP client");
+        free(client);
+        return NULL;
+    }
+
+    return client;
+}
+
+void http_client_destroy(http_client_t *client)
+{
+    if (client == NULL) {
+        return;
+    }
+
+    esp_http_client_cleanup(client->handle);
+    free(client);
+}
+
+int http_client_get(http_client_t *client, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    if (client == NULL || request == NULL || response == NULL) {
+        return METEOSWISS_ERROR;
+    }
+    http_response_start(response, request);
+
+    if (esp_http_client_set_url(client->handle, request->url) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set HTTP URL");
+        return METEOSWISS_ERROR;
+    }
+
+    esp_err_t err = esp_http_client_set_timeout_ms(client->handle, timeout_ms);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
-        return -1;
+        ESP_LOGE(TAG, "Failed to set HTTP timeout: %s", esp_err_to_name(err));
+        return METEOSWISS_ERROR;
     }
 
-    esp_http_client_cleanup(client);
+    // Conditional headers only apply to this request
+    esp_http_client_delete_header(client->handle, "If-None-Match");
+    esp_http_client_delete_header(client->handle, "If-Modified-Since");
+    if (request->if_none_match) {
+        esp_http_client_set_header(client->handle, "If-None-Match", request->if_none_match);
+    }
+    if (request->if_modified_since) {
+        esp_http_client_set_header(client->handle, "If-Modified-Since", request->if_modified_since);
+    }
+
+    // Only the total duration is known, the phases are not reported by esp_http_client
+    int64_t start_us = esp_timer_get_time();
+    esp_http_client_set_user_data(client->handle, response);
+    err = esp_http_client_perform(client->handle);
+    response->status_code = esp_http_client_get_status_code(client->handle);
+    response->timings.total_us = esp_timer_get_time() - start_us;
+    response->timings.bytes_received = (long long)response->body.length;
+
+    return transfer_status(err, &response->body);
+}
+
+int http_client_warm(http_client_t *client, const char *url, unsigned int timeout_ms)
+{
+    if (client == NULL || url == NULL) {
+        return METEOSWISS_ERROR;
+    }
+
+    if (esp_http_client_set_url(client->handle, url) != ESP_OK ||
+        esp_http_client_set_timeout_ms(client->handle, timeout_ms) != ESP_OK) {
+        return METEOSWISS_ERROR;
+    }
+    esp_http_client_delete_header(client->handle, "If-None-Match");
+    esp_http_client_delete_header(client->handle, "If-Modified-Since");
+
+    HttpResponse response;
+    http_response_init(&response, 0);
+    esp_http_client_set_method(client->handle, HTTP_METHOD_HEAD);
+    esp_http_client_set_user_data(client->handle, &response);
+    esp_err_t err = esp_http_client_perform(client->handle);
+    esp_http_client_set_method(client->handle, HTTP_METHOD_GET);
+    http_response_free(&response);
+
+    return (err == ESP_OK) ? METEOSWISS_SUCCESS : METEOSWISS_ERROR;
+}
+
+int http_client_get_hedged(http_client_t *client, const HttpRequest *request, HttpResponse *response,
+                           unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    // A single request at a time on this platform, the hedge is never sent
+    (void)hedge_delay_ms;
+    if (hedged) {
+        *hedged = 0;
+    }
+    return http_client_get(client, request, response, timeout_ms);
+}
+
+int http_client_get_batch(http_client_t *client, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                          unsigned int timeout_ms, http_batch_callback callback, void *userp)
+{
+    if (client == NULL || requests == NULL || callback == NULL || max_in_flight == 0) {
+        return METEOSWISS_ERROR;
+    }
+
+    // No concurrent transfers on the ESP32, the requests are performed one by one
+    HttpResponse response;
+    http_response_init(&response, client->max_response_size);
+
+    int status = METEOSWISS_SUCCESS;
+    for (size_t i = 0; i < count; i++) {
+        int result = http_client_get(client, &requests[i], &response, timeout_ms);
+        if (result != METEOSWISS_SUCCESS) {
+            status = METEOSWISS_ERROR;
+        }
+        callback(userp, i, result, &response);
+    }
+
+    http_response_free(&response);
+    return status;
+}
+
+http_async_t *http_async_create(const MeteoSwissClientConfig *config, http_share_t *share,
+                                meteoswiss_socket_callback socket_callback,
+                                meteoswiss_timer_callback timer_callback, void *userp)
+{
+    // esp_http_client has no non-blocking interface
+    return NULL;
+}
+
+void http_async_destroy(http_async_t *async)
+{
+}
+
+int http_async_get(http_async_t *async, const HttpRequest *request, unsigned int timeout_ms,
+                   http_async_callback callback, void *userp)
+{
+    return METEOSWISS_ERROR;
+}
+
+int http_async_socket_action(http_async_t *async, int fd, int events)
+{
+    return METEOSWISS_ERROR;
+}
+
+int http_async_timeout(http_async_t *async)
+{
+    return METEOSWISS_ERROR;
+}
+
+size_t http_async_running(const http_async_t *async)
+{
     return 0;
 }
 
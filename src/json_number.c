@@ -0,0 +1,224 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#if HTTP_WRAPPER_DESKTOP == 1
+#define _GNU_SOURCE // strtod_l()
+#endif
+
+#include "json_number.h"
+#include <limits.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HTTP_WRAPPER_DESKTOP == 1
+#include <pthread.h>
+#endif
+
+#define MAX_MANTISSA_DIGITS 19        // Always fit in 64 bits
+#define MAX_EXACT_MANTISSA (1ull << 53) // Largest mantissa a double holds exactly
+#define MAX_EXACT_POWER 22            // Largest power of ten a double holds exactly
+#define MAX_EXPONENT 100000           // Beyond this the result is 0 or infinite anyway
+#define FALLBACK_BUFFER_SIZE 64
+
+static const double powers_of_ten[MAX_EXACT_POWER + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+#if HTTP_WRAPPER_DESKTOP == 1
+
+static pthread_once_t c_locale_once = PTHREAD_ONCE_INIT;
+static locale_t c_locale = (locale_t)0;
+
+static void c_locale_create(void)
+{
+    c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+// strtod() in the C locale, whatever setlocale() the application or another thread calls
+static double strtod_c(const char *text)
+{
+    pthread_once(&c_locale_once, c_locale_create);
+    if (c_locale == (locale_t)0)
+    {
+        // Out of memory at the first fallback, the process most likely still runs in the C locale
+        return strtod(text, NULL);
+    }
+    return strtod_l(text, NULL, c_locale);
+}
+
+#else
+
+// The ESP32 only has the C locale
+static double strtod_c(const char *text)
+{
+    return strtod(text, NULL);
+}
+
+#endif
+
+// Convert with strtod() in the C locale, on a null-terminated copy
+static double fallback_to_double(const char *text, size_t length)
+{
+    char buffer[FALLBACK_BUFFER_SIZE];
+    char *copy = buffer;
+    if (length >= sizeof(buffer))
+    {
+        copy = malloc(length + 1);
+        if (copy == NULL)
+        {
+            return 0.0;
+        }
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    double value = strtod_c(copy);
+
+    if (copy != buffer)
+    {
+        free(copy);
+    }
+    return value;
+}
+
+double json_number_to_double(const char *text, size_t length)
+{
+    const char *p = text;
+    const char *end = text + length;
+
+    int negative = (p < end && *p == '-');
+    p += negative;
+
+    // Significant digits in a 64-bit mantissa, the number is mantissa * 10^exponent
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int truncated = 0;
+    for (; p < end && is_digit(*p); p++)
+    {
+        if (digits < MAX_MANTISSA_DIGITS)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += (mantissa != 0);
+        }
+        else
+        {
+            truncated |= (*p != '0');
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && is_digit(*p); p++)
+        {
+            if (digits < MAX_MANTISSA_DIGITS)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += (mantissa != 0);
+                exponent--;
+            }
+            else
+            {
+                truncated |= (*p != '0');
+            }
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        int exponent_negative = (p < end && *p == '-');
+        p += (p < end && (*p == '-' || *p == '+'));
+
+        int written = 0;
+        for (; p < end && is_digit(*p); p++)
+        {
+            if (written < MAX_EXPONENT)
+            {
+                written = written * 10 + (*p - '0');
+            }
+        }
+        exponent += exponent_negative ? -written : written;
+    }
+
+    // Both the mantissa and the power of ten are exact, so one rounding gives
+    // the correctly rounded result
+    if (p == end && !truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER &&
+        exponent <= MAX_EXACT_POWER)
+    {
+        double value = (double)mantissa;
+        if (exponent < 0)
+        {
+            value /= powers_of_ten[-exponent];
+        }
+        else
+        {
+            value *= powers_of_ten[exponent];
+        }
+        return negative ? -value : value;
+    }
+    return fallback_to_double(text, length);
+}
+
+long long json_number_to_long_long(const char *text, size_t length)
+{
+    const char *p = text;
+    const char *end = text + length;
+
+    int negative = (p < end && *p == '-');
+    p += negative;
+
+    // Accumulated as a negative number, whose range includes LLONG_MIN
+    long long value = 0;
+    for (; p < end && is_digit(*p); p++)
+    {
+        int digit = *p - '0';
+        if (value < (LLONG_MIN + digit) / 10)
+        {
+            return negative ? LLONG_MIN : LLONG_MAX;
+        }
+        value = value * 10 - digit;
+    }
+    if (negative)
+    {
+        return value;
+    }
+    return value == LLONG_MIN ? LLONG_MAX : -value;
+}
+
+int json_number_to_int(const char *text, size_t length)
+{
+    long long value = json_number_to_long_long(text, length);
+    if (value > INT_MAX)
+    {
+        return INT_MAX;
+    }
+    if (value < INT_MIN)
+    {
+        return INT_MIN;
+    }
+    return (int)value;
+}
@@ -0,0 +1,70 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Decode a JSON number into the nearest double.
+ *
+ * Independent of the locale, and reads the number in place: text does not
+ * need to be null-terminated. Numbers with at most 19 significant digits and
+ * a small exponent, like all the ones of plzDetail responses, are converted
+ * exactly with integer and floating-point arithmetic. The others fall back to
+ * strtod() in the C locale, through strtod_l() on desktop.
+ *
+ * @param text The number.
+ * @param length The length of the number.
+ * @return The number, correctly rounded like strtod() would.
+ */
+double json_number_to_double(const char *text, size_t length);
+
+/**
+ * @brief Decode the integer part of a JSON number, like atoll().
+ *
+ * Reading stops at the first character that is not a digit, and values out
+ * of range saturate.
+ *
+ * @param text The number, not null-terminated.
+ * @param length The length of the number.
+ * @return The integer part of the number.
+ */
+long long json_number_to_long_long(const char *text, size_t length);
+
+/**
+ * @brief Decode the integer part of a JSON number, like atoi().
+ *
+ * @param text The number, not null-terminated.
+ * @param length The length of the number.
+ * @return The integer part of the number, saturated to the range of int.
+ */
+int json_number_to_int(const char *text, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_NUMBER_H
@@ -0,0 +1,661 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Grammar states
+enum {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_END, // After '['
+    EXPECT_KEY,          // After ',' in an object
+    EXPECT_KEY_OR_END,   // After '{'
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_END,
+    EXPECT_DONE
+};
+
+// Tokens in progress
+enum {
+    LEXER_NONE,
+    LEXER_STRING,
+    LEXER_ESCAPE,
+    LEXER_UNICODE,
+    LEXER_NUMBER,
+    LEXER_LITERAL
+};
+
+#define CONTAINER_OBJECT 'o'
+#define CONTAINER_ARRAY 'a'
+
+#define SCRATCH_INITIAL_CAPACITY 64
+
+static int fail(JsonStream *stream)
+{
+    stream->error = 1;
+    return -1;
+}
+
+static int scratch_append(JsonStream *stream, const char *data, size_t length)
+{
+    if (length > stream->scratch_capacity - stream->scratch_length)
+    {
+        size_t capacity = stream->scratch_capacity ? stream->scratch_capacity : SCRATCH_INITIAL_CAPACITY;
+        while (capacity - stream->scratch_length < length)
+        {
+            capacity *= 2;
+        }
+
+        char *scratch = realloc(stream->scratch, capacity);
+        if (scratch == NULL)
+        {
+            return fail(stream);
+        }
+        stream->scratch = scratch;
+        stream->scratch_capacity = capacity;
+    }
+
+    memcpy(stream->scratch + stream->scratch_length, data, length);
+    stream->scratch_length += length;
+    stream->scratch_active = 1;
+    return 0;
+}
+
+static int emit(JsonStream *stream, JsonStreamEvent event, const char *text, size_t length)
+{
+    if (stream->callback(stream->userp, event, text, length) != 0)
+    {
+        return fail(stream);
+    }
+    return 0;
+}
+
+// Update the grammar state once a complete value has been reported
+static void value_done(JsonStream *stream)
+{
+    stream->expect = stream->depth ? EXPECT_COMMA_OR_END : EXPECT_DONE;
+}
+
+static int expects_value(const JsonStream *stream)
+{
+    return stream->expect == EXPECT_VALUE || stream->expect == EXPECT_VALUE_OR_END;
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int is_number_char(char c)
+{
+    return is_digit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// Check a number against the JSON grammar
+static int valid_number(const char *text, size_t length)
+{
+    size_t i = 0;
+
+    if (i < length && text[i] == '-')
+    {
+        i++;
+    }
+    if (i >= length)
+    {
+        return 0;
+    }
+    if (text[i] == '0')
+    {
+        i++;
+    }
+    else if (is_digit(text[i]))
+    {
+        while (i < length && is_digit(text[i]))
+        {
+            i++;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (i < length && text[i] == '.')
+    {
+        size_t start = ++i;
+        while (i < length && is_digit(text[i]))
+        {
+            i++;
+        }
+        if (i == start)
+        {
+            return 0;
+        }
+    }
+
+    if (i < length && (text[i] == 'e' || text[i] == 'E'))
+    {
+        i++;
+        if (i < length && (text[i] == '+' || text[i] == '-'))
+        {
+            i++;
+        }
+        size_t start = i;
+        while (i < length && is_digit(text[i]))
+        {
+            i++;
+        }
+        if (i == start)
+        {
+            return 0;
+        }
+    }
+
+    return i == length;
+}
+
+static int end_string(JsonStream *stream, const char *text, size_t length)
+{
+    int is_key = stream->is_key;
+
+    stream->lexer = LEXER_NONE;
+    if (emit(stream, is_key ? JSON_STREAM_KEY : JSON_STREAM_STRING, text, length) != 0)
+    {
+        return -1;
+    }
+
+    if (is_key)
+    {
+        stream->expect = EXPECT_COLON;
+    }
+    else
+    {
+        value_done(stream);
+    }
+    return 0;
+}
+
+static int end_number(JsonStream *stream, const char *text, size_t length)
+{
+    stream->lexer = LEXER_NONE;
+    if (!valid_number(text, length))
+    {
+        return fail(stream);
+    }
+    if (emit(stream, JSON_STREAM_NUMBER, text, length) != 0)
+    {
+        return -1;
+    }
+    value_done(stream);
+    return 0;
+}
+
+// Append a code point from a \u escape sequence, encoded as UTF-8
+static int append_code_point(JsonStream *stream, unsigned int code_point)
+{
+    char utf8[4];
+    size_t length;
+
+    if (code_point >= 0xD800 && code_point <= 0xDBFF)
+    {
+        // Wait for the low surrogate
+        stream->high_surrogate = code_point;
+        return 0;
+    }
+    if (code_point >= 0xDC00 && code_point <= 0xDFFF && stream->high_surrogate)
+    {
+        code_point = 0x10000 + ((stream->high_surrogate - 0xD800) << 10) + (code_point - 0xDC00);
+    }
+    stream->high_surrogate = 0;
+
+    if (code_point < 0x80)
+    {
+        utf8[0] = (char)code_point;
+        length = 1;
+    }
+    else if (code_point < 0x800)
+    {
+        utf8[0] = (char)(0xC0 | (code_point >> 6));
+        utf8[1] = (char)(0x80 | (code_point & 0x3F));
+        length = 2;
+    }
+    else if (code_point < 0x10000)
+    {
+        utf8[0] = (char)(0xE0 | (code_point >> 12));
+        utf8[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code_point & 0x3F));
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = (char)(0xF0 | (code_point >> 18));
+        utf8[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code_point & 0x3F));
+        length = 4;
+    }
+    return scratch_append(stream, utf8, length);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Consume string content, reporting the string in place when it has no escapes
+// and ends in the same chunk
+static int continue_string(JsonStream *stream, const char *data, size_t length, size_t *pos)
+{
+    size_t i = *pos;
+
+    while (i < length)
+    {
+        if (stream->lexer == LEXER_STRING)
+        {
+            size_t start = i;
+            while (i < length && data[i] != '"' && data[i] != '\\' && (unsigned char)data[i] >= 0x20)
+            {
+                i++;
+            }
+
+            if (i == length)
+            {
+                if (scratch_append(stream, data + start, i - start) != 0)
+                {
+                    return -1;
+                }
+                break;
+            }
+
+            char c = data[i++];
+            if (c == '"')
+            {
+                *pos = i;
+                if (stream->scratch_active)
+                {
+                    if (scratch_append(stream, data + start, i - 1 - start) != 0)
+                    {
+                        return -1;
+                    }
+                    return end_string(stream, stream->scratch, stream->scratch_length);
+                }
+                return end_string(stream, data + start, i - 1 - start);
+            }
+            if (c != '\\')
+            {
+                // Unescaped control character
+                return fail(stream);
+            }
+            if (scratch_append(stream, data + start, i - 1 - start) != 0)
+            {
+                return -1;
+            }
+            stream->lexer = LEXER_ESCAPE;
+        }
+        else if (stream->lexer == LEXER_ESCAPE)
+        {
+            char c = data[i++];
+            char unescaped;
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                unescaped = c;
+                break;
+            case 'b':
+                unescaped = '\b';
+                break;
+            case 'f':
+                unescaped = '\f';
+                break;
+            case 'n':
+                unescaped = '\n';
+                break;
+            case 'r':
+                unescaped = '\r';
+                break;
+            case 't':
+                unescaped = '\t';
+                break;
+            case 'u':
+                stream->lexer = LEXER_UNICODE;
+                stream->unicode = 0;
+                stream->unicode_digits = 0;
+                continue;
+            default:
+                return fail(stream);
+            }
+            if (scratch_append(stream, &unescaped, 1) != 0)
+            {
+                return -1;
+            }
+            stream->lexer = LEXER_STRING;
+        }
+        else
+        {
+            int value = hex_value(data[i++]);
+            if (value < 0)
+            {
+                return fail(stream);
+            }
+            stream->unicode = (stream->unicode << 4) | (unsigned int)value;
+            if (++stream->unicode_digits == 4)
+            {
+                if (append_code_point(stream, stream->unicode) != 0)
+                {
+                    return -1;
+                }
+                stream->lexer = LEXER_STRING;
+            }
+        }
+    }
+
+    *pos = i;
+    return 0;
+}
+
+// Consume number characters, the character ending the number is left unread
+static int continue_number(JsonStream *stream, const char *data, size_t length, size_t *pos)
+{
+    size_t start = *pos;
+    size_t i = start;
+
+    while (i < length && is_number_char(data[i]))
+    {
+        i++;
+    }
+    *pos = i;
+
+    if (i == length)
+    {
+        return scratch_append(stream, data + start, i - start);
+    }
+    if (stream->scratch_active)
+    {
+        if (scratch_append(stream, data + start, i - start) != 0)
+        {
+            return -1;
+        }
+        return end_number(stream, stream->scratch, stream->scratch_length);
+    }
+    return end_number(stream, data + start, i - start);
+}
+
+static int continue_literal(JsonStream *stream, const char *data, size_t length, size_t *pos)
+{
+    size_t i = *pos;
+
+    while (i < length && stream->literal[stream->literal_pos] != '\0')
+    {
+        if (data[i++] != stream->literal[stream->literal_pos++])
+        {
+            return fail(stream);
+        }
+    }
+    *pos = i;
+
+    if (stream->literal[stream->literal_pos] != '\0')
+    {
+        return 0;
+    }
+
+    JsonStreamEvent event = JSON_STREAM_NULL;
+    if (stream->literal[0] == 't')
+    {
+        event = JSON_STREAM_TRUE;
+    }
+    else if (stream->literal[0] == 'f')
+    {
+        event = JSON_STREAM_FALSE;
+    }
+
+    stream->lexer = LEXER_NONE;
+    if (emit(stream, event, NULL, 0) != 0)
+    {
+        return -1;
+    }
+    value_done(stream);
+    return 0;
+}
+
+static void begin_token(JsonStream *stream, int lexer)
+{
+    stream->lexer = lexer;
+    stream->scratch_length = 0;
+    stream->scratch_active = 0;
+}
+
+static int open_container(JsonStream *stream, unsigned char container)
+{
+    if (!expects_value(stream) || stream->depth == JSON_STREAM_MAX_DEPTH)
+    {
+        return fail(stream);
+    }
+
+    stream->stack[stream->depth++] = container;
+    if (container == CONTAINER_OBJECT)
+    {
+        stream->expect = EXPECT_KEY_OR_END;
+        return emit(stream, JSON_STREAM_OBJECT_BEGIN, NULL, 0);
+    }
+    stream->expect = EXPECT_VALUE_OR_END;
+    return emit(stream, JSON_STREAM_ARRAY_BEGIN, NULL, 0);
+}
+
+static int close_container(JsonStream *stream, unsigned char container)
+{
+    int empty = (container == CONTAINER_OBJECT) ? (stream->expect == EXPECT_KEY_OR_END)
+                                                : (stream->expect == EXPECT_VALUE_OR_END);
+    if (!empty && stream->expect != EXPECT_COMMA_OR_END)
+    {
+        return fail(stream);
+    }
+    if (stream->depth == 0 || stream->stack[stream->depth - 1] != container)
+    {
+        return fail(stream);
+    }
+
+    stream->depth--;
+    if (emit(stream, (container == CONTAINER_OBJECT) ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END, NULL, 0) != 0)
+    {
+        return -1;
+    }
+    value_done(stream);
+    return 0;
+}
+
+void json_stream_init(JsonStream *stream, json_stream_callback callback, void *userp)
+{
+    memset(stream, 0, sizeof(JsonStream));
+    stream->callback = callback;
+    stream->userp = userp;
+    json_stream_reset(stream);
+}
+
+void json_stream_reset(JsonStream *stream)
+{
+    stream->expect = EXPECT_VALUE;
+    stream->lexer = LEXER_NONE;
+    stream->error = 0;
+    stream->depth = 0;
+    stream->high_surrogate = 0;
+    stream->scratch_length = 0;
+    stream->scratch_active = 0;
+}
+
+int json_stream_feed(JsonStream *stream, const char *data, size_t length)
+{
+    size_t i = 0;
+
+    if (stream->error)
+    {
+        return -1;
+    }
+
+    while (i < length)
+    {
+        int result = 0;
+
+        switch (stream->lexer)
+        {
+        case LEXER_STRING:
+        case LEXER_ESCAPE:
+        case LEXER_UNICODE:
+            result = continue_string(stream, data, length, &i);
+            break;
+        case LEXER_NUMBER:
+            result = continue_number(stream, data, length, &i);
+            break;
+        case LEXER_LITERAL:
+            result = continue_literal(stream, data, length, &i);
+            break;
+        default:
+            switch (data[i])
+            {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                i++;
+                break;
+            case '{':
+                i++;
+                result = open_container(stream, CONTAINER_OBJECT);
+                break;
+            case '[':
+                i++;
+                result = open_container(stream, CONTAINER_ARRAY);
+                break;
+            case '}':
+                i++;
+                result = close_container(stream, CONTAINER_OBJECT);
+                break;
+            case ']':
+                i++;
+                result = close_container(stream, CONTAINER_ARRAY);
+                break;
+            case ',':
+                i++;
+                if (stream->expect != EXPECT_COMMA_OR_END)
+                {
+                    return fail(stream);
+                }
+                stream->expect = (stream->stack[stream->depth - 1] == CONTAINER_OBJECT) ? EXPECT_KEY : EXPECT_VALUE;
+                break;
+            case ':':
+                i++;
+                if (stream->expect != EXPECT_COLON)
+                {
+                    return fail(stream);
+                }
+                stream->expect = EXPECT_VALUE;
+                break;
+            case '"':
+                i++;
+                if (stream->expect == EXPECT_KEY || stream->expect == EXPECT_KEY_OR_END)
+                {
+                    stream->is_key = 1;
+                }
+                else if (expects_value(stream))
+                {
+                    stream->is_key = 0;
+                }
+                else
+                {
+                    return fail(stream);
+                }
+                begin_token(stream, LEXER_STRING);
+                break;
+            case 't':
+            case 'f':
+            case 'n':
+                if (!expects_value(stream))
+                {
+                    return fail(stream);
+                }
+                stream->literal = (data[i] == 't') ? "true" : (data[i] == 'f') ? "false" : "null";
+                stream->literal_pos = 1;
+                i++;
+                begin_token(stream, LEXER_LITERAL);
+                break;
+            default:
+                if (!(data[i] == '-' || is_digit(data[i])) || !expects_value(stream))
+                {
+                    return fail(stream);
+                }
+                begin_token(stream, LEXER_NUMBER);
+                break;
+            }
+            break;
+        }
+
+        if (result != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int json_stream_finish(JsonStream *stream)
+{
+    if (stream->error)
+    {
+        return -1;
+    }
+
+    // A number is only complete once a character follows it
+    if (stream->lexer == LEXER_NUMBER)
+    {
+        if (end_number(stream, stream->scratch, stream->scratch_length) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (stream->lexer != LEXER_NONE || stream->expect != EXPECT_DONE)
+    {
+        return fail(stream);
+    }
+    return 0;
+}
+
+void json_stream_free(JsonStream *stream)
+{
+    free(stream->scratch);
+    stream->scratch = NULL;
+    stream->scratch_capacity = 0;
+    stream->scratch_length = 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_STREAM_MAX_DEPTH 64
+
+/**
+ * @brief Events reported by the streaming tokenizer.
+ */
+typedef enum {
+    JSON_STREAM_OBJECT_BEGIN,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_BEGIN,
+    JSON_STREAM_ARRAY_END,
+    JSON_STREAM_KEY,
+    JSON_STREAM_STRING,
+    JSON_STREAM_NUMBER,
+    JSON_STREAM_TRUE,
+    JSON_STREAM_FALSE,
+    JSON_STREAM_NULL
+} JsonStreamEvent;
+
+/**
+ * @brief Receives the tokens of a JSON document.
+ *
+ * For keys, strings and numbers, text points to the token (unescaped for
+ * strings), it is not null-terminated and only valid during the call. For the
+ * other events text is NULL.
+ *
+ * @return 0 to continue, non-zero to stop the tokenizer with an error.
+ */
+typedef int (*json_stream_callback)(void *userp, JsonStreamEvent event, const char *text, size_t length);
+
+/**
+ * @brief State of a push tokenizer, fed with a JSON document chunk by chunk.
+ *
+ * Tokens that lie entirely inside a chunk are reported in place. Only tokens
+ * split across chunks, or strings with escape sequences, are copied.
+ */
+typedef struct {
+    json_stream_callback callback;
+    void *userp;
+
+    int expect;   // Grammar state, what may come next
+    int lexer;    // Token in progress, if any
+    int is_key;   // The string in progress is an object key
+    int error;
+
+    unsigned char stack[JSON_STREAM_MAX_DEPTH]; // Open containers
+    size_t depth;
+
+    // Literal in progress
+    const char *literal;
+    size_t literal_pos;
+
+    // Escape sequence in progress
+    unsigned int unicode;
+    unsigned int high_surrogate;
+    int unicode_digits;
+
+    // Copy of a token split across chunks
+    char *scratch;
+    size_t scratch_length;
+    size_t scratch_capacity;
+    int scratch_active;
+} JsonStream;
+
+/**
+ * @brief Initialize a tokenizer.
+ *
+ * @param stream The tokenizer.
+ * @param callback Receives the tokens.
+ * @param userp User pointer passed to the callback.
+ */
+void json_stream_init(JsonStream *stream, json_stream_callback callback, void *userp);
+
+/**
+ * @brief Reset a tokenizer for a new document, keeping its scratch buffer.
+ *
+ * @param stream The tokenizer.
+ */
+void json_stream_reset(JsonStream *stream);
+
+/**
+ * @brief Feed the next chunk of the document.
+ *
+ * @param stream The tokenizer.
+ * @param data The chunk.
+ * @param length The length of the chunk.
+ * @return 0 on success, non-zero on a syntax error or if the callback failed.
+ */
+int json_stream_feed(JsonStream *stream, const char *data, size_t length);
+
+/**
+ * @brief Signal the end of the document.
+ *
+ * @param stream The tokenizer.
+ * @return 0 if a complete document was received, non-zero otherwise.
+ */
+int json_stream_finish(JsonStream *stream);
+
+/**
+ * @brief Release the memory held by a tokenizer.
+ *
+ * @param stream The tokenizer.
+ */
+void json_stream_free(JsonStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_STREAM_H
@@ -19,20 +19,18 @@
  */
 
 #include "meteoswiss.h"
+#include "meteoswiss_internal.h"
 #include "http_client.h"
-#include "validate_json.h"
+#include "json_number.h"
+#include "plzdetail_keys.h"
+#include "plzdetail_stream.h"
 #include "json.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define METEOSWISS_URL "https://app-prod-ws.meteoswiss-app.ch/v1/plzDetail?plz="
-#define PLZ_FORMAT_STRING "%04d00"
-#define PLZ_LENGTH 6
-#define RESPONSE_BUFFER_SIZE 16384
+#include <time.h>
 
 // Prototypes
-static struct json_value_s *get_object_value(struct json_object_s *object, const char *key);
 static int json_value_to_int(struct json_value_s *value, int *out_int);
 static int json_value_to_long_long(struct json_value_s *value, long long *out_long_long);
 static int json_value_to_float(struct json_value_s *value, float *out_float);
@@ -41,6 +39,7 @@ static int parse_current_weather(struct json_object_s *json_obj, CurrentWeather
 static int parse_forecast(struct json_array_s *json_array, ForecastEntry **forecast, size_t *count);
 static int parse_graph(struct json_object_s *json_obj, WeatherGraph *graph);
 static int parse_float_array(struct json_array_s *json_array, float **out_array, size_t *out_count);
+static int parse_root(struct json_value_s *root, MeteoSwissData *data);
 
 // API functions
 int meteoswiss_query(int postal_code, MeteoSwissData *data, unsigned int timeout)
@@ -50,135 +49,186 @@ int meteoswiss_query(int postal_code, MeteoSwissData *data, unsigned int timeout
         return -1;
     }
 
-    static char url[sizeof(METEOSWISS_URL) + PLZ_LENGTH + 1] = METEOSWISS_URL;
-    snprintf(url + sizeof(METEOSWISS_URL) - 1, PLZ_LENGTH + 1, PLZ_FORMAT_STRING, postal_code);
+    char url[METEOSWISS_URL_SIZE];
+    meteoswiss_format_url(url, sizeof(url), NULL, postal_code);
 
-    char response[RESPONSE_BUFFER_SIZE];
-    if (https_get(url, response, sizeof(response), timeout) != 0)
-    {
-        return -1;
-    }
+    HttpBuffer response;
+    http_buffer_init(&response, METEOSWISS_DEFAULT_MAX_RESPONSE_SIZE);
 
-    struct json_value_s *root = json_parse(response, strlen(response));
-    if (root == NULL)
+    int status = https_get(url, &response, timeout);
+    if (status == METEOSWISS_SUCCESS)
     {
-        return -1;
+        status = meteoswiss_parse_response(response.data, response.length, data, NULL);
     }
 
-    struct json_object_s *root_obj = json_value_as_object(root);
-    if (root_obj == NULL)
-    {
-        free(root);
-        return -1;
-    }
+    http_buffer_free(&response);
+    return status;
+}
 
-    if(validate_json(root) != VALIDATE_JSON_SUCCESS)
+void meteoswiss_data_free(MeteoSwissData *data)
+{
+    if (data)
     {
-        free(root);
-        return -1;
+        // Free forecast entries
+        if (data->forecast)
+        {
+            free(data->forecast);
+            data->forecast = NULL;
+            data->forecast_count = 0;
+            data->forecast_capacity = 0;
+        }
+        // Free graph data arrays
+        if (data->graph.precipitation10m)
+        {
+            free(data->graph.precipitation10m);
+            data->graph.precipitation10m = NULL;
+            data->graph.precipitation10m_count = 0;
+            data->graph.precipitation10m_capacity = 0;
+        }
+        // Free other arrays as needed
     }
+}
 
-    memset(data, 0, sizeof(MeteoSwissData));
+// Internal functions shared with the client context
+void meteoswiss_format_url(char *url, size_t url_size, const char *base_url, int postal_code)
+{
+    snprintf(url, url_size, "%s" METEOSWISS_PLZ_PATH PLZ_FORMAT_STRING, base_url ? base_url : METEOSWISS_BASE_URL,
+             postal_code);
+}
+
+int meteoswiss_data_copy(MeteoSwissData *dest, const MeteoSwissData *src)
+{
+    *dest = *src;
+    dest->forecast = NULL;
+    dest->forecast_capacity = 0;
+    dest->graph.precipitation10m = NULL;
+    dest->graph.precipitation10m_capacity = 0;
 
-    // Parse currentWeather
-    struct json_value_s *current_weather_val = get_object_value(root_obj, "currentWeather");
-    if (current_weather_val)
+    if (src->forecast && src->forecast_count)
     {
-        struct json_object_s *current_weather_obj = json_value_as_object(current_weather_val);
-        if (current_weather_obj)
+        dest->forecast = malloc(src->forecast_count * sizeof(ForecastEntry));
+        if (dest->forecast == NULL)
         {
-            if (parse_current_weather(current_weather_obj, &data->currentWeather) != 0)
-            {
-                free(root);
-                return -1;
-            }
+            meteoswiss_data_free(dest);
+            return -1;
         }
+        memcpy(dest->forecast, src->forecast, src->forecast_count * sizeof(ForecastEntry));
+        dest->forecast_capacity = src->forecast_count;
     }
-    else
+    if (src->graph.precipitation10m && src->graph.precipitation10m_count)
     {
-        return -1;
+        dest->graph.precipitation10m = malloc(src->graph.precipitation10m_count * sizeof(float));
+        if (dest->graph.precipitation10m == NULL)
+        {
+            meteoswiss_data_free(dest);
+            return -1;
+        }
+        memcpy(dest->graph.precipitation10m, src->graph.precipitation10m, src->graph.precipitation10m_count * sizeof(float));
+        dest->graph.precipitation10m_capacity = src->graph.precipitation10m_count;
     }
+    // Copy other arrays as needed
+    return 0;
+}
 
-    // Parse forecast
-    struct json_value_s *forecast_val = get_object_value(root_obj, "forecast");
-    if (forecast_val)
+int meteoswiss_data_assign(MeteoSwissData *dest, const MeteoSwissData *src)
+{
+    // Grow the arrays first, so that a failure leaves dest consistent
+    if (src->forecast_count > dest->forecast_capacity)
     {
-        struct json_array_s *forecast_array = json_value_as_array(forecast_val);
-        if (forecast_array)
+        ForecastEntry *forecast = realloc(dest->forecast, src->forecast_count * sizeof(ForecastEntry));
+        if (forecast == NULL)
         {
-            if (parse_forecast(forecast_array, &data->forecast, &data->forecast_count) != 0)
-            {
-                free(root);
-                return -1;
-            }
+            return -1;
         }
+        dest->forecast = forecast;
+        dest->forecast_capacity = src->forecast_count;
     }
-    else
+    if (src->graph.precipitation10m_count > dest->graph.precipitation10m_capacity)
     {
-        return -1;
+        float *array = realloc(dest->graph.precipitation10m, src->graph.precipitation10m_count * sizeof(float));
+        if (array == NULL)
+        {
+            return -1;
+        }
+        dest->graph.precipitation10m = array;
+        dest->graph.precipitation10m_capacity = src->graph.precipitation10m_count;
     }
 
-    // Parse graph
-    struct json_value_s *graph_val = get_object_value(root_obj, "graph");
-    if (graph_val)
+    ForecastEntry *forecast = dest->forecast;
+    size_t forecast_capacity = dest->forecast_capacity;
+    float *precipitation10m = dest->graph.precipitation10m;
+    size_t precipitation10m_capacity = dest->graph.precipitation10m_capacity;
+
+    *dest = *src;
+    dest->forecast = forecast;
+    dest->forecast_capacity = forecast_capacity;
+    dest->graph.precipitation10m = precipitation10m;
+    dest->graph.precipitation10m_capacity = precipitation10m_capacity;
+    if (src->forecast_count)
     {
-        struct json_object_s *graph_obj = json_value_as_object(graph_val);
-        if (graph_obj)
-        {
-            if (parse_graph(graph_obj, &data->graph) != 0)
-            {
-                free(root);
-                return -1;
-            }
-        }
+        memcpy(dest->forecast, src->forecast, src->forecast_count * sizeof(ForecastEntry));
     }
-    else
+    if (src->graph.precipitation10m_count)
     {
-        return -1;
+        memcpy(dest->graph.precipitation10m, src->graph.precipitation10m, src->graph.precipitation10m_count * sizeof(float));
     }
-
-    // Clean up
-    free(root);
+    // Copy other arrays as needed
     return 0;
 }
 
-void meteoswiss_data_free(MeteoSwissData *data)
+int meteoswiss_parse_response(const char *response, size_t length, MeteoSwissData *data, MeteoSwissQueryStats *stats)
 {
-    if (data)
+    long long start_us = stats ? meteoswiss_cpu_time_us() : 0;
+
+    int result = plzdetail_parse(response, length, data);
+    if (stats)
     {
-        // Free forecast entries
-        if (data->forecast)
-        {
-            free(data->forecast);
-            data->forecast = NULL;
-            data->forecast_count = 0;
-        }
-        // Free graph data arrays
-        if (data->graph.precipitation10m)
-        {
-            free(data->graph.precipitation10m);
-            data->graph.precipitation10m = NULL;
-            data->graph.precipitation10m_count = 0;
-        }
-        // Free other arrays as needed
+        stats->parse_us = meteoswiss_cpu_time_us() - start_us;
     }
+    return result;
 }
 
-// Helper function to get a value from a JSON object by key
-static struct json_value_s *get_object_value(struct json_object_s *object, const char *key)
+int meteoswiss_parse_response_dom(const char *response, size_t length, MeteoSwissData *data,
+                                  MeteoSwissQueryStats *stats)
 {
-    struct json_object_element_s *elem = object->start;
-    size_t key_len = strlen(key);
-    while (elem)
+    long long start_us = stats ? meteoswiss_cpu_time_us() : 0;
+
+    struct json_value_s *root = json_parse(response, length);
+    if (root == NULL)
     {
-        if (elem->name->string_size == key_len &&
-            strncmp(elem->name->string, key, key_len) == 0)
+        if (stats)
         {
-            return elem->value;
+            stats->parse_us = meteoswiss_cpu_time_us() - start_us;
         }
-        elem = elem->next;
+        return -1;
     }
-    return NULL;
+
+    // A single walk of the DOM validates the document while extracting it
+    memset(data, 0, sizeof(MeteoSwissData));
+    int result = parse_root(root, data);
+    if (result != 0)
+    {
+        meteoswiss_data_free(data);
+    }
+
+    // Clean up
+    free(root);
+    if (stats)
+    {
+        stats->parse_us = meteoswiss_cpu_time_us() - start_us;
+    }
+    return result;
+}
+
+long long meteoswiss_cpu_time_us(void)
+{
+    struct timespec now;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
 }
 
 // Helper functions to convert JSON values to C types
@@ -187,7 +237,7 @@ static int json_value_to_int(struct json_value_s *value, int *out_int)
     struct json_number_s *num = json_value_as_number(value);
     if (num)
     {
-        *out_int = atoi(num->number);
+        *out_int = json_number_to_int(num->number, num->number_size);
         return 0;
     }
     return -1;
@@ -198,7 +248,7 @@ static int json_value_to_long_long(struct json_value_s *value, long long *out_lo
     struct json_number_s *num = json_value_as_number(value);
     if (num)
     {
-        *out_long_long = atoll(num->number);
+        *out_long_long = json_number_to_long_long(num->number, num->number_size);
         return 0;
     }
     return -1;
@@ -209,7 +259,7 @@ static int json_value_to_float(struct json_value_s *value, float *out_float)
     struct json_number_s *num = json_value_as_number(value);
     if (num)
     {
-        *out_float = atof(num->number);
+        *out_float = (float)json_number_to_double(num->number, num->number_size);
         return 0;
     }
     return -1;
@@ -228,26 +278,21 @@ static int json_value_to_string(struct json_value_s *value, char *buffer, size_t
     return -1;
 }
 
+// The extraction functions below also validate the document: each object
+// must hold all its required keys, checked as its members are dispatched
+
 static int parse_current_weather(struct json_object_s *json_obj, CurrentWeather *current_weather)
 {
-    struct json_value_s *value;
-
-    if ((value = get_object_value(json_obj, "time")) != NULL)
-    {
-        json_value_to_long_long(value, &current_weather->time);
-    }
-    if ((value = get_object_value(json_obj, "icon")) != NULL)
-    {
-        json_value_to_int(value, &current_weather->icon);
-    }
-    if ((value = get_object_value(json_obj, "iconV2")) != NULL)
+    struct json_value_s *values[CURRENT_KEY_COUNT];
+    if (plzdetail_object_members(json_obj, PLZ_KEYS_CURRENT, values) != PLZ_ALL_KEYS(CURRENT_KEY_COUNT))
     {
-        json_value_to_int(value, &current_weather->iconV2);
-    }
-    if ((value = get_object_value(json_obj, "temperature")) != NULL)
-    {
-        json_value_to_float(value, &current_weather->temperature);
+        return -1;
     }
+
+    json_value_to_long_long(values[CURRENT_TIME], &current_weather->time);
+    json_value_to_int(values[CURRENT_ICON], &current_weather->icon);
+    json_value_to_int(values[CURRENT_ICON_V2], &current_weather->iconV2);
+    json_value_to_float(values[CURRENT_TEMPERATURE], &current_weather->temperature);
     return 0;
 }
 
@@ -255,6 +300,10 @@ static int parse_forecast(struct json_array_s *json_array, ForecastEntry **forec
 {
     size_t idx = 0;
     *count = json_array->length;
+    if (*count == 0)
+    {
+        return 0;
+    }
     *forecast = calloc(*count, sizeof(ForecastEntry));
     if (*forecast == NULL)
     {
@@ -265,44 +314,23 @@ static int parse_forecast(struct json_array_s *json_array, ForecastEntry **forec
     while (element)
     {
         struct json_object_s *forecast_obj = json_value_as_object(element->value);
-        if (forecast_obj)
+        struct json_value_s *values[ENTRY_KEY_COUNT];
+        if (forecast_obj == NULL ||
+            plzdetail_object_members(forecast_obj, PLZ_KEYS_ENTRY, values) != PLZ_ALL_KEYS(ENTRY_KEY_COUNT))
         {
-            ForecastEntry *entry = &(*forecast)[idx];
-            struct json_value_s *value;
-
-            if ((value = get_object_value(forecast_obj, "dayDate")) != NULL)
-            {
-                json_value_to_string(value, entry->dayDate, sizeof(entry->dayDate));
-            }
-            if ((value = get_object_value(forecast_obj, "iconDay")) != NULL)
-            {
-                json_value_to_int(value, &entry->iconDay);
-            }
-            if ((value = get_object_value(forecast_obj, "iconDayV2")) != NULL)
-            {
-                json_value_to_int(value, &entry->iconDayV2);
-            }
-            if ((value = get_object_value(forecast_obj, "temperatureMax")) != NULL)
-            {
-                json_value_to_float(value, &entry->temperatureMax);
-            }
-            if ((value = get_object_value(forecast_obj, "temperatureMin")) != NULL)
-            {
-                json_value_to_float(value, &entry->temperatureMin);
-            }
-            if ((value = get_object_value(forecast_obj, "precipitation")) != NULL)
-            {
-                json_value_to_float(value, &entry->precipitation);
-            }
-            if ((value = get_object_value(forecast_obj, "precipitationMin")) != NULL)
-            {
-                json_value_to_float(value, &entry->precipitationMin);
-            }
-            if ((value = get_object_value(forecast_obj, "precipitationMax")) != NULL)
-            {
-                json_value_to_float(value, &entry->precipitationMax);
-            }
+            return -1;
         }
+
+        ForecastEntry *entry = &(*forecast)[idx];
+        json_value_to_string(values[ENTRY_DAY_DATE], entry->dayDate, sizeof(entry->dayDate));
+        json_value_to_int(values[ENTRY_ICON_DAY], &entry->iconDay);
+        json_value_to_int(values[ENTRY_ICON_DAY_V2], &entry->iconDayV2);
+        json_value_to_float(values[ENTRY_TEMPERATURE_MAX], &entry->temperatureMax);
+        json_value_to_float(values[ENTRY_TEMPERATURE_MIN], &entry->temperatureMin);
+        json_value_to_float(values[ENTRY_PRECIPITATION], &entry->precipitation);
+        json_value_to_float(values[ENTRY_PRECIPITATION_MIN], &entry->precipitationMin);
+        json_value_to_float(values[ENTRY_PRECIPITATION_MAX], &entry->precipitationMax);
+
         element = element->next;
         idx++;
     }
@@ -312,6 +340,10 @@ static int parse_forecast(struct json_array_s *json_array, ForecastEntry **forec
 static int parse_float_array(struct json_array_s *json_array, float **out_array, size_t *out_count)
 {
     size_t count = json_array->length;
+    if (count == 0)
+    {
+        return 0;
+    }
     float *array = calloc(count, sizeof(float));
     if (array == NULL)
     {
@@ -325,7 +357,7 @@ static int parse_float_array(struct json_array_s *json_array, float **out_array,
         struct json_number_s *num = json_value_as_number(element->value);
         if (num)
         {
-            array[idx] = atof(num->number);
+            array[idx] = (float)json_number_to_double(num->number, num->number_size);
         }
         element = element->next;
         idx++;
@@ -338,27 +370,59 @@ static int parse_float_array(struct json_array_s *json_array, float **out_array,
 
 static int parse_graph(struct json_object_s *json_obj, WeatherGraph *graph)
 {
-    struct json_value_s *value;
-
-    if ((value = get_object_value(json_obj, "start")) != NULL)
-    {
-        json_value_to_long_long(value, &graph->start);
-    }
-    if ((value = get_object_value(json_obj, "startLowResolution")) != NULL)
+    struct json_value_s *values[GRAPH_KEY_COUNT];
+    if (plzdetail_object_members(json_obj, PLZ_KEYS_GRAPH, values) != PLZ_ALL_KEYS(GRAPH_KEY_COUNT))
     {
-        json_value_to_long_long(value, &graph->startLowResolution);
+        return -1;
     }
-    if ((value = get_object_value(json_obj, "precipitation10m")) != NULL)
+    for (size_t i = GRAPH_FIRST_ARRAY; i < GRAPH_KEY_COUNT; i++)
     {
-        struct json_array_s *array = json_value_as_array(value);
-        if (array)
+        if (json_value_as_array(values[i]) == NULL)
         {
-            if (parse_float_array(array, &graph->precipitation10m, &graph->precipitation10m_count) != 0)
-            {
-                return -1;
-            }
+            return -1;
         }
     }
+
+    json_value_to_long_long(values[GRAPH_START], &graph->start);
+    json_value_to_long_long(values[GRAPH_START_LOW_RESOLUTION], &graph->startLowResolution);
+    if (parse_float_array(json_value_as_array(values[GRAPH_PRECIPITATION_10M]), &graph->precipitation10m,
+                          &graph->precipitation10m_count) != 0)
+    {
+        return -1;
+    }
     // Parse other arrays as needed
     return 0;
 }
+
+static int parse_root(struct json_value_s *root, MeteoSwissData *data)
+{
+    struct json_object_s *root_obj = json_value_as_object(root);
+    struct json_value_s *sections[ROOT_KEY_COUNT];
+    if (root_obj == NULL || plzdetail_object_members(root_obj, PLZ_KEYS_ROOT, sections) != PLZ_ALL_KEYS(ROOT_KEY_COUNT))
+    {
+        return -1;
+    }
+
+    struct json_object_s *current_weather_obj = json_value_as_object(sections[ROOT_CURRENT_WEATHER]);
+    struct json_array_s *forecast_array = json_value_as_array(sections[ROOT_FORECAST]);
+    struct json_object_s *graph_obj = json_value_as_object(sections[ROOT_GRAPH]);
+    if (current_weather_obj == NULL || forecast_array == NULL || graph_obj == NULL)
+    {
+        return -1;
+    }
+
+    // Required, but the content is not extracted
+    if (json_value_as_array(sections[ROOT_WARNINGS]) == NULL ||
+        json_value_as_array(sections[ROOT_WARNINGS_OVERVIEW]) == NULL)
+    {
+        return -1;
+    }
+
+    if (parse_current_weather(current_weather_obj, &data->currentWeather) != 0 ||
+        parse_forecast(forecast_array, &data->forecast, &data->forecast_count) != 0 ||
+        parse_graph(graph_obj, &data->graph) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
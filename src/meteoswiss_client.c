@@ -0,0 +1,1866 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "meteoswiss.h"
+#include "meteoswiss_internal.h"
+#include "http_client.h"
+#include "plzdetail_stream.h"
+#include "transport.h"
+#include <errno.h>
+#include <arpa/inet.h>
+#include <limits.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_KEEPALIVE_IDLE_S 60
+#define DEFAULT_KEEPALIVE_INTERVAL_S 30
+#define DEFAULT_MAX_IDLE_S 118
+#define DEFAULT_MAX_IN_FLIGHT 16
+#define DEFAULT_BACKOFF_BASE_MS 100
+#define DEFAULT_BACKOFF_MAX_MS 2000
+#define DEFAULT_BREAKER_MIN_REQUESTS 10
+#define DEFAULT_BREAKER_OPEN_MS 5000
+#define DEFAULT_WARM_TIMEOUT_MS 10000
+
+// Resolution of the host pinned for the connections of a client
+#define RESOLVE_RETRY_MS 5000
+#define RESOLVE_MAX_ADDRESSES 4
+#define RESOLVE_HOST_SIZE 256
+#define RESOLVE_ENTRY_SIZE (RESOLVE_HOST_SIZE + 8 + RESOLVE_MAX_ADDRESSES * (INET6_ADDRSTRLEN + 3))
+
+// Outcomes of the recent requests considered by the circuit breaker
+#define BREAKER_WINDOW 32
+
+// Recent query latencies kept to derive the hedge delay
+#define LATENCY_SAMPLES 64
+#define HEDGE_MIN_SAMPLES 16
+#define HEDGE_PERCENTILE 95
+
+// Postal codes are formatted with four digits
+#define PLZ_CACHE_SIZE 10000
+
+// Size hints: a new sample weighs 1/SIZE_HINT_WEIGHT of the moving average,
+// and 1/SIZE_HINT_MARGIN of it is allocated on top
+#define SIZE_HINT_WEIGHT 4
+#define SIZE_HINT_MARGIN 8
+
+// Validators and last parsed result of a postal code, for conditional requests
+typedef struct
+{
+    char etag[HTTP_VALIDATOR_SIZE];
+    char last_modified[HTTP_VALIDATOR_SIZE];
+    MeteoSwissData data;
+} PlzCacheEntry;
+
+// Sizes of the recent responses of a postal code, as moving averages
+typedef struct
+{
+    unsigned int body_size;
+    unsigned short forecast_count;
+    unsigned short precipitation_count;
+} PlzSizeHint;
+
+// URL of a postal code and a private copy of its cached validators and size hint
+typedef struct
+{
+    char url[METEOSWISS_URL_SIZE];
+    char if_none_match[HTTP_VALIDATOR_SIZE];
+    char if_modified_since[HTTP_VALIDATOR_SIZE];
+    PlzSizeHint hint;
+} PlzRequest;
+
+// Connection and buffers used by one query at a time
+typedef struct QueryWorker
+{
+    meteoswiss_transport_t *transport;
+    void *connection;          // Connection of the transport, like an HTTP client handle
+    HttpResponse response;     // Kept between queries to avoid reallocating it
+    PlzDetailStream stream;    // Parser of the responses, kept between queries like the response
+    long long stream_cpu_us;   // CPU time spent in the incremental parser during the transfer
+    unsigned int seed;         // State of the backoff jitter
+    struct QueryWorker *next;  // Next idle worker
+} QueryWorker;
+
+// Progress of the warm-up of the connections
+typedef enum
+{
+    WARM_NONE,
+    WARM_PENDING,
+    WARM_READY,
+    WARM_FAILED
+} WarmState;
+
+// Warm-up of the connection of one worker, on its own thread
+typedef struct
+{
+    QueryWorker *worker;
+    const char *url;
+    unsigned int timeout_ms;
+    int status;
+    pthread_t thread;
+    int started;
+} WarmTask;
+
+// A fetch shared by the concurrent queries of one postal code
+typedef struct Flight
+{
+    int postal_code;
+    MeteoSwissPriority priority;  // Promoted to interactive when an interactive query joins
+    int done;
+    int status;
+    MeteoSwissData data;          // Copy of the result for the waiters, its arrays kept while spare
+    MeteoSwissQueryStats stats;
+    size_t waiters;               // Queries waiting for the result, the last one releases the flight
+    struct Flight *next;
+} Flight;
+
+struct meteoswiss_client
+{
+    MeteoSwissClientConfig config;
+
+    pthread_mutex_t lock;         // Protects the members below
+    pthread_cond_t flight_done;   // Signaled when any flight completes
+    QueryWorker *idle_workers;    // Created on demand, one per concurrent query
+    Flight *flights;              // Fetches in progress
+    Flight *spare_flights;        // Completed flights, reused by the next fetches
+    PlzCacheEntry **plz_cache;    // Indexed by postal code, allocated on first use
+    PlzSizeHint *size_hints;      // Indexed by postal code, allocated on first use
+
+    unsigned int latency_ms[LATENCY_SAMPLES]; // Ring of the latencies of recent successful attempts
+    size_t latency_count;
+    size_t latency_next;
+
+    pthread_cond_t rate_wake;     // Signaled when an interactive query took its tokens
+    double rate_tokens;           // Tokens in the bucket, refilled at rate_limit per second
+    long long rate_refill_ms;     // Time of the last refill
+    size_t rate_interactive;      // Interactive queries waiting for tokens
+
+    MeteoSwissCircuitState breaker_state;
+    unsigned char breaker_failed[BREAKER_WINDOW]; // Ring of the outcomes of recent requests, 1 for a failure
+    size_t breaker_count;
+    size_t breaker_next;
+    size_t breaker_failures;      // Failures in the ring
+    long long breaker_open_until_ms;
+    int breaker_probing;          // Set while the probe of the half-open state is in progress
+
+    pthread_cond_t warm_done;     // Signaled when the warm-up completes
+    WarmState warm_state;
+    pthread_t warm_thread;
+    int warm_started;             // Set when warm_thread must be joined
+
+    pthread_cond_t resolver_wake; // Signaled to stop the resolver
+    pthread_t resolver_thread;
+    int resolver_started;         // Set when resolver_thread must be joined
+    int resolver_stop;
+    char resolve_entry[RESOLVE_ENTRY_SIZE]; // "host:port:addresses" of the last resolution, empty if none
+
+    // Copies of the strings of the configuration, which points to them
+    char base_url[METEOSWISS_BASE_URL_SIZE];
+    char *unix_socket_path;
+    char warm_url[METEOSWISS_BASE_URL_SIZE + sizeof(METEOSWISS_WARM_PATH)];
+    char resolve_host[RESOLVE_HOST_SIZE]; // Host resolved in the background, empty if none
+    int resolve_port;
+};
+
+struct meteoswiss_share
+{
+    http_share_t *http;
+};
+
+// Client whose queries are driven by the event loop of the application
+struct meteoswiss_async
+{
+    meteoswiss_client_t *client; // Configuration and cache of the validators
+    http_async_t *http;
+    size_t running;
+};
+
+// An asynchronous query in progress
+typedef struct
+{
+    meteoswiss_async_t *async;
+    int postal_code;
+    meteoswiss_query_callback callback;
+    void *userp;
+    int streaming;
+    int probe;                  // Set when the query is the probe of a half-open breaker
+    PlzDetailStream stream;
+    long long stream_cpu_us;
+} AsyncQuery;
+
+// Destination of the results of a batch query
+typedef struct
+{
+    meteoswiss_client_t *client;
+    const int *postal_codes;
+    const PlzRequest *storage;  // Size hints of the postal codes
+    PlzDetailStream *stream;    // Parser of the worker, for one response at a time
+    MeteoSwissData *data;
+    int *status;
+    int probe;                  // Set when the only request is the probe of a half-open breaker
+    size_t failures;
+} BatchContext;
+
+meteoswiss_share_t *meteoswiss_share_create(void)
+{
+    meteoswiss_share_t *share = calloc(1, sizeof(meteoswiss_share_t));
+    if (share == NULL)
+    {
+        return NULL;
+    }
+
+    share->http = http_share_create();
+    if (share->http == NULL)
+    {
+        free(share);
+        return NULL;
+    }
+
+    return share;
+}
+
+void meteoswiss_share_destroy(meteoswiss_share_t *share)
+{
+    if (share == NULL)
+    {
+        return;
+    }
+
+    http_share_destroy(share->http);
+    free(share);
+}
+
+int meteoswiss_share_save_tls_sessions(meteoswiss_share_t *share, const char *path)
+{
+    return share ? http_share_save_tls_sessions(share->http, path) : METEOSWISS_ERROR;
+}
+
+int meteoswiss_share_load_tls_sessions(meteoswiss_share_t *share, const char *path)
+{
+    return share ? http_share_load_tls_sessions(share->http, path) : METEOSWISS_ERROR;
+}
+
+void meteoswiss_client_config_init(MeteoSwissClientConfig *config)
+{
+    if (config == NULL)
+    {
+        return;
+    }
+
+    memset(config, 0, sizeof(MeteoSwissClientConfig));
+    config->keepalive_idle_s = DEFAULT_KEEPALIVE_IDLE_S;
+    config->keepalive_interval_s = DEFAULT_KEEPALIVE_INTERVAL_S;
+    config->max_idle_s = DEFAULT_MAX_IDLE_S;
+    config->max_response_size = METEOSWISS_DEFAULT_MAX_RESPONSE_SIZE;
+    config->compression = 1;
+    config->max_attempts = 1;
+    config->backoff_base_ms = DEFAULT_BACKOFF_BASE_MS;
+    config->backoff_max_ms = DEFAULT_BACKOFF_MAX_MS;
+    config->breaker_min_requests = DEFAULT_BREAKER_MIN_REQUESTS;
+    config->breaker_open_ms = DEFAULT_BREAKER_OPEN_MS;
+}
+
+static long long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+// Wait on a condition of the client until signaled or until wake_ms on the monotonic clock,
+// 0 for no limit. The client lock must be held.
+static void cond_wait_until(meteoswiss_client_t *client, pthread_cond_t *cond, long long wake_ms)
+{
+    if (wake_ms == 0)
+    {
+        pthread_cond_wait(cond, &client->lock);
+        return;
+    }
+
+    long long delay_ms = wake_ms - monotonic_ms();
+    if (delay_ms <= 0)
+    {
+        return;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += delay_ms / 1000;
+    deadline.tv_nsec += (long)(delay_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, &client->lock, &deadline);
+}
+
+static QueryWorker *worker_create(const MeteoSwissClientConfig *config)
+{
+    QueryWorker *worker = calloc(1, sizeof(QueryWorker));
+    if (worker == NULL)
+    {
+        return NULL;
+    }
+
+    http_share_t *share = config->share ? config->share->http : NULL;
+    worker->transport = config->transport ? config->transport : transport_default();
+    worker->connection = worker->transport->ops->open(worker->transport->state, config, share);
+    if (worker->connection == NULL)
+    {
+        free(worker);
+        return NULL;
+    }
+    http_response_init(&worker->response, config->max_response_size);
+    plzdetail_stream_init(&worker->stream);
+    worker->seed = (unsigned int)time(NULL) ^ (unsigned int)(size_t)worker;
+    return worker;
+}
+
+static void worker_destroy(QueryWorker *worker)
+{
+    worker->transport->ops->close(worker->connection);
+    http_response_free(&worker->response);
+    plzdetail_stream_free(&worker->stream);
+    free(worker);
+}
+
+// Take an idle worker, or create one if all are busy
+static QueryWorker *worker_acquire(meteoswiss_client_t *client)
+{
+    pthread_mutex_lock(&client->lock);
+    QueryWorker *worker = client->idle_workers;
+    if (worker)
+    {
+        client->idle_workers = worker->next;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    if (worker == NULL)
+    {
+        worker = worker_create(&client->config);
+    }
+    return worker;
+}
+
+static void worker_release(meteoswiss_client_t *client, QueryWorker *worker)
+{
+    pthread_mutex_lock(&client->lock);
+    worker->next = client->idle_workers;
+    client->idle_workers = worker;
+    pthread_mutex_unlock(&client->lock);
+}
+
+static void *warm_connection(void *userp)
+{
+    WarmTask *task = (WarmTask *)userp;
+    QueryWorker *worker = task->worker;
+
+    task->status = METEOSWISS_SUCCESS;
+    if (worker->transport->ops->warm)
+    {
+        task->status = worker->transport->ops->warm(worker->connection, task->url, task->timeout_ms);
+    }
+    return NULL;
+}
+
+// Open the connections of as many workers as configured, concurrently
+static void *warm_workers(void *userp)
+{
+    meteoswiss_client_t *client = (meteoswiss_client_t *)userp;
+    size_t count = client->config.warm_connections;
+    unsigned int timeout_ms = client->config.connect_timeout_ms > 0 ? (unsigned int)client->config.connect_timeout_ms
+                                                                    : DEFAULT_WARM_TIMEOUT_MS;
+
+    // The workers are all held until the end, so that each task warms a different one
+    WarmTask *tasks = calloc(count, sizeof(WarmTask));
+    size_t acquired = 0;
+    while (tasks && acquired < count && (tasks[acquired].worker = worker_acquire(client)) != NULL)
+    {
+        tasks[acquired].url = client->warm_url;
+        tasks[acquired].timeout_ms = timeout_ms;
+        tasks[acquired].status = METEOSWISS_ERROR;
+        acquired++;
+    }
+
+    for (size_t i = 1; i < acquired; i++)
+    {
+        tasks[i].started = (pthread_create(&tasks[i].thread, NULL, warm_connection, &tasks[i]) == 0);
+    }
+    if (acquired > 0)
+    {
+        warm_connection(&tasks[0]);
+    }
+
+    size_t ready = 0;
+    for (size_t i = 0; i < acquired; i++)
+    {
+        if (tasks[i].started)
+        {
+            pthread_join(tasks[i].thread, NULL);
+        }
+        ready += (tasks[i].status == METEOSWISS_SUCCESS);
+        worker_release(client, tasks[i].worker);
+    }
+    free(tasks);
+
+    pthread_mutex_lock(&client->lock);
+    client->warm_state = ready ? WARM_READY : WARM_FAILED;
+    pthread_cond_broadcast(&client->warm_done);
+    pthread_mutex_unlock(&client->lock);
+    return NULL;
+}
+
+// Take the host and port of the base URL to resolve in the background. IP
+// literals are left alone since there is nothing to resolve.
+static void parse_resolve_host(meteoswiss_client_t *client)
+{
+    const char *host = strstr(client->base_url, "://");
+    if (host == NULL)
+    {
+        return;
+    }
+    int port = strncmp(client->base_url, "https", 5) == 0 ? 443 : 80;
+    host += 3;
+
+    size_t length = strcspn(host, ":/");
+    if (length == 0 || length >= sizeof(client->resolve_host) || host[0] == '[')
+    {
+        return;
+    }
+    if (host[length] == ':')
+    {
+        port = atoi(host + length + 1);
+    }
+    memcpy(client->resolve_host, host, length);
+    client->resolve_host[length] = '\0';
+
+    unsigned char address[sizeof(struct in6_addr)];
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, client->resolve_host, address) == 1)
+    {
+        client->resolve_host[0] = '\0';
+        return;
+    }
+    client->resolve_port = port;
+}
+
+// Resolve the host of the client into a "host:port:addresses" entry, 0 if none could be found
+static int resolve_host(const meteoswiss_client_t *client, char *entry, size_t size)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(client->resolve_host, NULL, &hints, &result) != 0)
+    {
+        return 0;
+    }
+
+    size_t length = (size_t)snprintf(entry, size, "%s:%d:", client->resolve_host, client->resolve_port);
+    int count = 0;
+    for (struct addrinfo *info = result; info && count < RESOLVE_MAX_ADDRESSES; info = info->ai_next)
+    {
+        char address[INET6_ADDRSTRLEN];
+        const void *source = info->ai_family == AF_INET6
+                                 ? (const void *)&((struct sockaddr_in6 *)info->ai_addr)->sin6_addr
+                                 : (const void *)&((struct sockaddr_in *)info->ai_addr)->sin_addr;
+        if ((info->ai_family != AF_INET && info->ai_family != AF_INET6) ||
+            inet_ntop(info->ai_family, source, address, sizeof(address)) == NULL ||
+            strstr(entry + length, address))
+        {
+            continue;
+        }
+        const char *format = info->ai_family == AF_INET6 ? "%s[%s]" : "%s%s";
+        length += (size_t)snprintf(entry + length, size - length, format, count ? "," : "", address);
+        count++;
+    }
+    freeaddrinfo(result);
+    return count;
+}
+
+// Keep the addresses of the host current until the client is destroyed. getaddrinfo()
+// does not expose the TTL of the records, so they are refreshed at a fixed interval.
+static void *resolver_run(void *userp)
+{
+    meteoswiss_client_t *client = (meteoswiss_client_t *)userp;
+    char entry[RESOLVE_ENTRY_SIZE];
+
+    pthread_mutex_lock(&client->lock);
+    while (!client->resolver_stop)
+    {
+        pthread_mutex_unlock(&client->lock);
+        int found = resolve_host(client, entry, sizeof(entry));
+        pthread_mutex_lock(&client->lock);
+
+        // On failure the previous addresses are kept, and the lookup is retried sooner
+        long long interval_ms = (long long)client->config.dns_refresh_s * 1000LL;
+        if (found)
+        {
+            memcpy(client->resolve_entry, entry, sizeof(entry));
+        }
+        else if (interval_ms > RESOLVE_RETRY_MS)
+        {
+            interval_ms = RESOLVE_RETRY_MS;
+        }
+
+        long long wake_ms = monotonic_ms() + interval_ms;
+        while (!client->resolver_stop && monotonic_ms() < wake_ms)
+        {
+            cond_wait_until(client, &client->resolver_wake, wake_ms);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return NULL;
+}
+
+// Copy the pinned addresses of the host for a request, NULL if there are none
+static const char *resolve_snapshot(meteoswiss_client_t *client, char *entry)
+{
+    if (client->resolve_host[0] == '\0')
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&client->lock);
+    memcpy(entry, client->resolve_entry, RESOLVE_ENTRY_SIZE);
+    pthread_mutex_unlock(&client->lock);
+    return entry[0] ? entry : NULL;
+}
+
+// Copy the service endpoint of the configuration into the client, which
+// then owns the strings the configuration points to
+static int copy_endpoint(meteoswiss_client_t *client)
+{
+    const char *base_url = client->config.base_url ? client->config.base_url : METEOSWISS_BASE_URL;
+    size_t length = strlen(base_url);
+    while (length > 0 && base_url[length - 1] == '/')
+    {
+        length--;
+    }
+    if (length == 0 || length >= sizeof(client->base_url))
+    {
+        return -1;
+    }
+    memcpy(client->base_url, base_url, length);
+    client->base_url[length] = '\0';
+    client->config.base_url = client->base_url;
+    snprintf(client->warm_url, sizeof(client->warm_url), "%s" METEOSWISS_WARM_PATH, client->base_url);
+
+    if (client->config.unix_socket_path)
+    {
+        client->unix_socket_path = strdup(client->config.unix_socket_path);
+        if (client->unix_socket_path == NULL)
+        {
+            return -1;
+        }
+        client->config.unix_socket_path = client->unix_socket_path;
+    }
+    else if (client->config.dns_refresh_s > 0)
+    {
+        parse_resolve_host(client);
+    }
+    return 0;
+}
+
+meteoswiss_client_t *meteoswiss_client_create(const MeteoSwissClientConfig *config)
+{
+    meteoswiss_client_t *client = calloc(1, sizeof(meteoswiss_client_t));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+
+    if (config)
+    {
+        client->config = *config;
+    }
+    else
+    {
+        meteoswiss_client_config_init(&client->config);
+    }
+    if (copy_endpoint(client) != 0)
+    {
+        free(client->unix_socket_path);
+        free(client);
+        return NULL;
+    }
+
+    // The first worker is created upfront, so a client that is used from a
+    // single thread behaves like a single HTTP handle
+    client->idle_workers = worker_create(&client->config);
+    if (client->idle_workers == NULL)
+    {
+        free(client->unix_socket_path);
+        free(client);
+        return NULL;
+    }
+
+    if (client->config.rate_limit > 0 && client->config.rate_burst == 0)
+    {
+        // Rounded up, a bucket smaller than one token would never let a request through
+        client->config.rate_burst = (unsigned int)client->config.rate_limit;
+        if (client->config.rate_burst < client->config.rate_limit)
+        {
+            client->config.rate_burst++;
+        }
+    }
+    client->rate_tokens = client->config.rate_burst;
+    client->rate_refill_ms = monotonic_ms();
+
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_cond_init(&client->flight_done, NULL);
+    pthread_cond_init(&client->rate_wake, NULL);
+    pthread_cond_init(&client->warm_done, NULL);
+    pthread_cond_init(&client->resolver_wake, NULL);
+
+    if (client->resolve_host[0])
+    {
+        client->resolver_started = (pthread_create(&client->resolver_thread, NULL, resolver_run, client) == 0);
+    }
+
+    if (client->config.warm_connections > 0)
+    {
+        client->warm_state = WARM_PENDING;
+        client->warm_started = (pthread_create(&client->warm_thread, NULL, warm_workers, client) == 0);
+        if (!client->warm_started)
+        {
+            client->warm_state = WARM_FAILED;
+        }
+    }
+    return client;
+}
+
+void meteoswiss_client_destroy(meteoswiss_client_t *client)
+{
+    if (client == NULL)
+    {
+        return;
+    }
+
+    if (client->warm_started)
+    {
+        pthread_join(client->warm_thread, NULL);
+    }
+    if (client->resolver_started)
+    {
+        pthread_mutex_lock(&client->lock);
+        client->resolver_stop = 1;
+        pthread_cond_broadcast(&client->resolver_wake);
+        pthread_mutex_unlock(&client->lock);
+        pthread_join(client->resolver_thread, NULL);
+    }
+
+    while (client->idle_workers)
+    {
+        QueryWorker *worker = client->idle_workers;
+        client->idle_workers = worker->next;
+        worker_destroy(worker);
+    }
+    while (client->spare_flights)
+    {
+        Flight *flight = client->spare_flights;
+        client->spare_flights = flight->next;
+        meteoswiss_data_free(&flight->data);
+        free(flight);
+    }
+
+    if (client->plz_cache)
+    {
+        for (size_t i = 0; i < PLZ_CACHE_SIZE; i++)
+        {
+            if (client->plz_cache[i])
+            {
+                meteoswiss_data_free(&client->plz_cache[i]->data);
+                free(client->plz_cache[i]);
+            }
+        }
+        free(client->plz_cache);
+    }
+    free(client->size_hints);
+
+    free(client->unix_socket_path);
+    pthread_cond_destroy(&client->resolver_wake);
+    pthread_cond_destroy(&client->warm_done);
+    pthread_cond_destroy(&client->rate_wake);
+    pthread_cond_destroy(&client->flight_done);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+}
+
+// Get the cache entry of a postal code, NULL if there is none. The client lock must be held.
+static PlzCacheEntry *cache_lookup(meteoswiss_client_t *client, int postal_code)
+{
+    if (client->plz_cache == NULL || postal_code < 0 || postal_code >= PLZ_CACHE_SIZE)
+    {
+        return NULL;
+    }
+    return client->plz_cache[postal_code];
+}
+
+// Remember the validators and the result of a response for the next request.
+// The client lock must be held.
+static void cache_store(meteoswiss_client_t *client, int postal_code, const HttpResponse *response,
+                        const MeteoSwissData *data)
+{
+    if (postal_code < 0 || postal_code >= PLZ_CACHE_SIZE)
+    {
+        return;
+    }
+
+    if (client->plz_cache == NULL)
+    {
+        client->plz_cache = calloc(PLZ_CACHE_SIZE, sizeof(PlzCacheEntry *));
+        if (client->plz_cache == NULL)
+        {
+            return;
+        }
+    }
+
+    PlzCacheEntry *entry = client->plz_cache[postal_code];
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(PlzCacheEntry));
+        if (entry == NULL)
+        {
+            return;
+        }
+        client->plz_cache[postal_code] = entry;
+    }
+
+    // The arrays of the previous result are reused, they rarely need to grow
+    if (meteoswiss_data_assign(&entry->data, data) != 0)
+    {
+        // Without a result to fall back on, the validators must not be sent
+        meteoswiss_data_free(&entry->data);
+        free(entry);
+        client->plz_cache[postal_code] = NULL;
+        return;
+    }
+    memcpy(entry->etag, response->etag, sizeof(entry->etag));
+    memcpy(entry->last_modified, response->last_modified, sizeof(entry->last_modified));
+}
+
+// Exponentially weighted moving average, the first sample is taken as is
+static unsigned int size_hint_average(unsigned int average, size_t sample, unsigned int max)
+{
+    unsigned int value = (sample < max) ? (unsigned int)sample : max;
+    if (average == 0)
+    {
+        return value;
+    }
+    return (unsigned int)(((unsigned long long)average * (SIZE_HINT_WEIGHT - 1) + value) / SIZE_HINT_WEIGHT);
+}
+
+// Learn the sizes of a response of a postal code. The client lock must be held.
+static void size_hint_record(meteoswiss_client_t *client, int postal_code, size_t body_size,
+                             const MeteoSwissData *data)
+{
+    if (postal_code < 0 || postal_code >= PLZ_CACHE_SIZE)
+    {
+        return;
+    }
+
+    if (client->size_hints == NULL)
+    {
+        client->size_hints = calloc(PLZ_CACHE_SIZE, sizeof(PlzSizeHint));
+        if (client->size_hints == NULL)
+        {
+            return;
+        }
+    }
+
+    PlzSizeHint *hint = &client->size_hints[postal_code];
+    hint->body_size = size_hint_average(hint->body_size, body_size, UINT_MAX);
+    hint->forecast_count = (unsigned short)size_hint_average(hint->forecast_count, data->forecast_count, USHRT_MAX);
+    hint->precipitation_count = (unsigned short)size_hint_average(hint->precipitation_count,
+                                                                  data->graph.precipitation10m_count, USHRT_MAX);
+}
+
+// Size to allocate for an expected size, with a margin for the variations around the average
+static size_t size_hint_margin(size_t size)
+{
+    return size ? size + size / SIZE_HINT_MARGIN + 1 : 0;
+}
+
+// Fill the request of a postal code, conditional if a previous result is cached.
+// resolve is the snapshot of the pinned addresses from resolve_snapshot().
+static void prepare_request(meteoswiss_client_t *client, int postal_code, const char *resolve, PlzRequest *storage,
+                            HttpRequest *request)
+{
+    meteoswiss_format_url(storage->url, sizeof(storage->url), client->config.base_url, postal_code);
+    memset(request, 0, sizeof(HttpRequest));
+    request->url = storage->url;
+    request->resolve = resolve;
+    memset(&storage->hint, 0, sizeof(PlzSizeHint));
+
+    // The validators are copied, the entry may be replaced while the request is in progress
+    pthread_mutex_lock(&client->lock);
+    if (client->size_hints && postal_code >= 0 && postal_code < PLZ_CACHE_SIZE)
+    {
+        storage->hint = client->size_hints[postal_code];
+        request->size_hint = size_hint_margin(storage->hint.body_size);
+    }
+
+    PlzCacheEntry *entry = client->config.conditional_get ? cache_lookup(client, postal_code) : NULL;
+    if (entry)
+    {
+        memcpy(storage->if_none_match, entry->etag, sizeof(storage->if_none_match));
+        memcpy(storage->if_modified_since, entry->last_modified, sizeof(storage->if_modified_since));
+        request->if_none_match = storage->if_none_match[0] ? storage->if_none_match : NULL;
+        request->if_modified_since = storage->if_modified_since[0] ? storage->if_modified_since : NULL;
+    }
+    pthread_mutex_unlock(&client->lock);
+}
+
+// Feed the incremental parser of a worker with the body as it downloads
+static int stream_sink(void *userp, const char *data, size_t size)
+{
+    QueryWorker *worker = (QueryWorker *)userp;
+
+    long long start_us = meteoswiss_cpu_time_us();
+    int result = plzdetail_stream_feed(&worker->stream, data, size);
+    worker->stream_cpu_us += meteoswiss_cpu_time_us() - start_us;
+    return result;
+}
+
+// Prepare a parser for the next response of a postal code, its arrays sized
+// from the previous responses so that they do not grow during the parse
+static void parser_start(PlzDetailStream *stream, const PlzSizeHint *hint)
+{
+    plzdetail_stream_reset(stream);
+    plzdetail_stream_reserve(stream, size_hint_margin(hint->forecast_count), size_hint_margin(hint->precipitation_count));
+}
+
+// Turn the response of a postal code into weather data with the parser
+// started for it. If streamed is set, the body was already fed to the parser
+// during the transfer, using stream_cpu_us of CPU time. If reuse is set, the
+// result goes into the arrays already in data.
+static int handle_response(meteoswiss_client_t *client, int postal_code, int status, const HttpResponse *response,
+                           PlzDetailStream *stream, int streamed, long long stream_cpu_us, MeteoSwissData *data,
+                           int reuse, MeteoSwissQueryStats *stats)
+{
+    if (stats && response)
+    {
+        stats->http_status = response->status_code;
+        stats->dns_us = response->timings.dns_us;
+        stats->connect_us = response->timings.connect_us;
+        stats->tls_us = response->timings.tls_us;
+        stats->wait_us = response->timings.wait_us;
+        stats->transfer_us = response->timings.transfer_us;
+        stats->total_us = response->timings.total_us;
+        stats->bytes_received = response->timings.bytes_received;
+        stats->body_size = response->body.length;
+    }
+    if (status != METEOSWISS_SUCCESS)
+    {
+        return status;
+    }
+
+    // Unchanged since the previous query, hand out the cached result
+    if (response->status_code == 304)
+    {
+        pthread_mutex_lock(&client->lock);
+        PlzCacheEntry *entry = cache_lookup(client, postal_code);
+        if (entry == NULL)
+        {
+            status = METEOSWISS_ERROR;
+        }
+        else
+        {
+            status = (reuse ? meteoswiss_data_assign(data, &entry->data) : meteoswiss_data_copy(data, &entry->data)) == 0
+                         ? METEOSWISS_SUCCESS
+                         : METEOSWISS_ERROR;
+        }
+        pthread_mutex_unlock(&client->lock);
+
+        if (stats && status == METEOSWISS_SUCCESS)
+        {
+            stats->not_modified = 1;
+        }
+        return status;
+    }
+
+    long long start_us = meteoswiss_cpu_time_us();
+    if (!streamed && plzdetail_stream_feed(stream, response->body.data, response->body.length) != 0)
+    {
+        plzdetail_stream_reset(stream);
+        status = METEOSWISS_ERROR;
+    }
+    else
+    {
+        status = reuse ? plzdetail_stream_finish_into(stream, data) : plzdetail_stream_finish(stream, data);
+    }
+    if (stats)
+    {
+        stats->parse_us = stream_cpu_us + meteoswiss_cpu_time_us() - start_us;
+    }
+    if (status == METEOSWISS_SUCCESS)
+    {
+        pthread_mutex_lock(&client->lock);
+        size_hint_record(client, postal_code, response->body.length, data);
+        if (client->config.conditional_get && (response->etag[0] || response->last_modified[0]))
+        {
+            cache_store(client, postal_code, response, data);
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    return status;
+}
+
+static void sleep_ms(unsigned int ms)
+{
+    struct timespec duration = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
+}
+
+static void latency_record(meteoswiss_client_t *client, long long latency_ms)
+{
+    pthread_mutex_lock(&client->lock);
+    client->latency_ms[client->latency_next] = (unsigned int)latency_ms;
+    client->latency_next = (client->latency_next + 1) % LATENCY_SAMPLES;
+    if (client->latency_count < LATENCY_SAMPLES)
+    {
+        client->latency_count++;
+    }
+    pthread_mutex_unlock(&client->lock);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    unsigned int left = *(const unsigned int *)a;
+    unsigned int right = *(const unsigned int *)b;
+    return (left > right) - (left < right);
+}
+
+// Delay before an attempt is hedged, 0 while there are too few samples to derive it
+static unsigned int hedge_delay(meteoswiss_client_t *client)
+{
+    if (client->config.hedge_delay_ms)
+    {
+        return client->config.hedge_delay_ms;
+    }
+
+    unsigned int samples[LATENCY_SAMPLES];
+    pthread_mutex_lock(&client->lock);
+    size_t count = client->latency_count;
+    memcpy(samples, client->latency_ms, count * sizeof(unsigned int));
+    pthread_mutex_unlock(&client->lock);
+
+    if (count < HEDGE_MIN_SAMPLES)
+    {
+        return 0;
+    }
+    qsort(samples, count, sizeof(unsigned int), compare_latency);
+    unsigned int delay = samples[(count * HEDGE_PERCENTILE + 99) / 100 - 1];
+    return delay ? delay : 1;
+}
+
+// Add the tokens earned since the last refill. The client lock must be held.
+static void rate_refill(meteoswiss_client_t *client, long long now_ms)
+{
+    client->rate_tokens += (double)(now_ms - client->rate_refill_ms) * client->config.rate_limit / 1000.0;
+    if (client->rate_tokens > client->config.rate_burst)
+    {
+        client->rate_tokens = client->config.rate_burst;
+    }
+    client->rate_refill_ms = now_ms;
+}
+
+// Take count tokens from the rate limiter, waiting for them until deadline_ms
+// on the monotonic clock, 0 for no limit. Background queries yield to the
+// interactive ones waiting. The priority is read under the client lock on
+// every wake-up, a background flight joined by an interactive query stops
+// yielding as soon as it is promoted.
+static int rate_acquire(meteoswiss_client_t *client, const MeteoSwissPriority *priority, unsigned int count,
+                        long long deadline_ms, MeteoSwissQueryStats *stats)
+{
+    if (client->config.rate_limit <= 0)
+    {
+        return METEOSWISS_SUCCESS;
+    }
+
+    int interactive = 0;
+    long long start_ms = monotonic_ms();
+    int status = METEOSWISS_SUCCESS;
+
+    pthread_mutex_lock(&client->lock);
+    for (;;)
+    {
+        if (!interactive && *priority == METEOSWISS_PRIORITY_INTERACTIVE)
+        {
+            interactive = 1;
+            client->rate_interactive++;
+        }
+
+        long long now_ms = monotonic_ms();
+        rate_refill(client, now_ms);
+
+        long long wake_ms = 0;
+        if (interactive || client->rate_interactive == 0)
+        {
+            if (client->rate_tokens >= count)
+            {
+                client->rate_tokens -= count;
+                break;
+            }
+            wake_ms = now_ms + (long long)((count - client->rate_tokens) * 1000.0 / client->config.rate_limit) + 1;
+        }
+
+        // No point in waiting for tokens that only come after the deadline
+        if (deadline_ms && (wake_ms == 0 ? now_ms >= deadline_ms : wake_ms > deadline_ms))
+        {
+            status = METEOSWISS_ERROR_RATE_LIMITED;
+            break;
+        }
+        cond_wait_until(client, &client->rate_wake, wake_ms ? wake_ms : deadline_ms);
+    }
+    if (interactive && --client->rate_interactive == 0)
+    {
+        pthread_cond_broadcast(&client->rate_wake);
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    if (stats)
+    {
+        stats->throttle_us += (monotonic_ms() - start_ms) * 1000;
+    }
+    return status;
+}
+
+// Whether a request may be sent. When the open period is over, the first
+// request is admitted as the probe of the half-open state.
+static int breaker_admit(meteoswiss_client_t *client, int *probe)
+{
+    *probe = 0;
+    if (client->config.breaker_failure_percent == 0)
+    {
+        return METEOSWISS_SUCCESS;
+    }
+
+    int status = METEOSWISS_SUCCESS;
+    pthread_mutex_lock(&client->lock);
+    if (client->breaker_state == METEOSWISS_CIRCUIT_OPEN && monotonic_ms() >= client->breaker_open_until_ms)
+    {
+        client->breaker_state = METEOSWISS_CIRCUIT_HALF_OPEN;
+    }
+    if (client->breaker_state == METEOSWISS_CIRCUIT_HALF_OPEN && !client->breaker_probing)
+    {
+        client->breaker_probing = 1;
+        *probe = 1;
+    }
+    else if (client->breaker_state != METEOSWISS_CIRCUIT_CLOSED)
+    {
+        status = METEOSWISS_ERROR_CIRCUIT_OPEN;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return status;
+}
+
+// Give back the probe of an admitted request that was not sent after all
+static void breaker_abandon(meteoswiss_client_t *client, int probe)
+{
+    if (probe)
+    {
+        pthread_mutex_lock(&client->lock);
+        client->breaker_probing = 0;
+        pthread_mutex_unlock(&client->lock);
+    }
+}
+
+static void breaker_open(meteoswiss_client_t *client)
+{
+    client->breaker_state = METEOSWISS_CIRCUIT_OPEN;
+    client->breaker_open_until_ms = monotonic_ms() + client->config.breaker_open_ms;
+    client->breaker_probing = 0;
+}
+
+// Account the outcome of a sent request, probe as given by breaker_admit()
+static void breaker_record(meteoswiss_client_t *client, int probe, int failed)
+{
+    if (client->config.breaker_failure_percent == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    // Only the outcome of the probe decides while half-open, the window starts
+    // over once closed. Requests admitted before the breaker opened may still
+    // complete, they say nothing of the state of the upstream since then.
+    if (client->breaker_state == METEOSWISS_CIRCUIT_HALF_OPEN && probe)
+    {
+        if (failed)
+        {
+            breaker_open(client);
+        }
+        else
+        {
+            client->breaker_state = METEOSWISS_CIRCUIT_CLOSED;
+            client->breaker_probing = 0;
+            client->breaker_count = 0;
+            client->breaker_next = 0;
+            client->breaker_failures = 0;
+        }
+    }
+    else if (client->breaker_state == METEOSWISS_CIRCUIT_CLOSED)
+    {
+        if (client->breaker_count == BREAKER_WINDOW)
+        {
+            client->breaker_failures -= client->breaker_failed[client->breaker_next];
+        }
+        else
+        {
+            client->breaker_count++;
+        }
+        client->breaker_failed[client->breaker_next] = (unsigned char)(failed != 0);
+        client->breaker_failures += (failed != 0);
+        client->breaker_next = (client->breaker_next + 1) % BREAKER_WINDOW;
+
+        if (client->breaker_count >= client->config.breaker_min_requests &&
+            client->breaker_failures * 100 >= client->config.breaker_failure_percent * client->breaker_count)
+        {
+            breaker_open(client);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+}
+
+MeteoSwissCircuitState meteoswiss_client_circuit_state(meteoswiss_client_t *client)
+{
+    if (client == NULL)
+    {
+        return METEOSWISS_CIRCUIT_CLOSED;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    MeteoSwissCircuitState state = client->breaker_state;
+    if (state == METEOSWISS_CIRCUIT_OPEN && monotonic_ms() >= client->breaker_open_until_ms)
+    {
+        state = METEOSWISS_CIRCUIT_HALF_OPEN;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return state;
+}
+
+int meteoswiss_client_wait_ready(meteoswiss_client_t *client, unsigned int timeout_ms)
+{
+    if (client == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    long long deadline_ms = timeout_ms ? monotonic_ms() + timeout_ms : 0;
+    pthread_mutex_lock(&client->lock);
+    while (client->warm_state == WARM_PENDING && (deadline_ms == 0 || monotonic_ms() < deadline_ms))
+    {
+        cond_wait_until(client, &client->warm_done, deadline_ms);
+    }
+    int status = (client->warm_state == WARM_NONE || client->warm_state == WARM_READY) ? METEOSWISS_SUCCESS
+                                                                                        : METEOSWISS_ERROR;
+    pthread_mutex_unlock(&client->lock);
+    return status;
+}
+
+// Random backoff before a retry, between 0 and the exponential bound ("full jitter")
+static unsigned int backoff_delay(const MeteoSwissClientConfig *config, QueryWorker *worker, unsigned int retry)
+{
+    unsigned long long bound = config->backoff_base_ms;
+    for (unsigned int i = 0; i < retry && bound < config->backoff_max_ms; i++)
+    {
+        bound *= 2;
+    }
+    if (bound > config->backoff_max_ms)
+    {
+        bound = config->backoff_max_ms;
+    }
+    return (unsigned int)(rand_r(&worker->seed) % (bound + 1));
+}
+
+// Whether an attempt may succeed when repeated: a transport failure or a
+// server-side error, but not a body the incremental parser rejected
+static int should_retry(int status, const HttpResponse *response, const PlzDetailStream *stream)
+{
+    if (response->status_code >= 500 || response->status_code == 429)
+    {
+        return 1;
+    }
+    return status == METEOSWISS_ERROR && !(stream && stream->json.error);
+}
+
+// Account the outcome of a request completed outside of fetch(), judging its latency by its timings
+static void breaker_record_response(meteoswiss_client_t *client, int probe, int status, const HttpResponse *response)
+{
+    long long slow_us = (long long)client->config.breaker_slow_ms * 1000;
+    breaker_record(client, probe,
+                   should_retry(status, response, NULL) || (slow_us && response->timings.total_us > slow_us));
+}
+
+// Fetch and parse a postal code on a worker of the client, retrying within the timeout
+static int fetch(meteoswiss_client_t *client, int postal_code, const MeteoSwissPriority *priority, MeteoSwissData *data,
+                 int reuse, unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    QueryWorker *worker = worker_acquire(client);
+    if (worker == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    PlzRequest storage;
+    HttpRequest request;
+    char resolve[RESOLVE_ENTRY_SIZE];
+    prepare_request(client, postal_code, resolve_snapshot(client, resolve), &storage, &request);
+
+    const MeteoSwissClientConfig *config = &client->config;
+    unsigned int max_attempts = config->max_attempts ? config->max_attempts : 1;
+    long long deadline_ms = timeout_ms ? monotonic_ms() + timeout_ms : 0;
+
+    QueryWorker *stream_worker = NULL;
+    HttpResponse *response = NULL;
+    int status = METEOSWISS_ERROR;
+    for (unsigned int attempt = 0; attempt < max_attempts; attempt++)
+    {
+        // A retry that is not let through reports the failure of the previous attempt
+        int probe;
+        if (breaker_admit(client, &probe) != METEOSWISS_SUCCESS)
+        {
+            if (attempt == 0)
+            {
+                status = METEOSWISS_ERROR_CIRCUIT_OPEN;
+            }
+            break;
+        }
+        if (rate_acquire(client, priority, 1, deadline_ms, stats) != METEOSWISS_SUCCESS)
+        {
+            breaker_abandon(client, probe);
+            if (attempt == 0)
+            {
+                status = METEOSWISS_ERROR_RATE_LIMITED;
+            }
+            break;
+        }
+
+        long long start_ms = monotonic_ms();
+        unsigned int remaining_ms = 0;
+        if (deadline_ms)
+        {
+            if (start_ms >= deadline_ms)
+            {
+                breaker_abandon(client, probe);
+                break;
+            }
+            remaining_ms = (unsigned int)(deadline_ms - start_ms);
+        }
+
+        unsigned int delay_ms = config->hedge ? hedge_delay(client) : 0;
+        int hedged = 0;
+        stream_worker = NULL;
+        request.sink = NULL;
+        parser_start(&worker->stream, &storage.hint);
+        worker->stream_cpu_us = 0;
+        if (delay_ms && (remaining_ms == 0 || delay_ms < remaining_ms))
+        {
+            // Two transfers cannot feed one incremental parser, the body is parsed once downloaded
+            status = worker->transport->ops->get_hedged(worker->connection, &request, &worker->response,
+                                                        remaining_ms, delay_ms, &hedged);
+        }
+        else
+        {
+            if (config->streaming_parse)
+            {
+                stream_worker = worker;
+                request.sink = stream_sink;
+                request.sink_userp = worker;
+            }
+            status = worker->transport->ops->get(worker->connection, &request, &worker->response, remaining_ms);
+        }
+
+        response = &worker->response;
+        if (stats)
+        {
+            stats->attempts++;
+            stats->hedged |= hedged;
+        }
+        int retry = should_retry(status, &worker->response, stream_worker ? &worker->stream : NULL);
+        long long latency_ms = monotonic_ms() - start_ms;
+        if (status == METEOSWISS_SUCCESS && !retry)
+        {
+            latency_record(client, latency_ms);
+        }
+        breaker_record(client, probe, retry || (config->breaker_slow_ms && latency_ms > config->breaker_slow_ms));
+        if (!retry || attempt + 1 == max_attempts)
+        {
+            break;
+        }
+
+        // Give up early rather than sleep past the deadline
+        unsigned int backoff_ms = backoff_delay(config, worker, attempt);
+        if (deadline_ms && monotonic_ms() + backoff_ms >= deadline_ms)
+        {
+            break;
+        }
+        sleep_ms(backoff_ms);
+    }
+
+    status = handle_response(client, postal_code, status, response, &worker->stream, stream_worker != NULL,
+                             worker->stream_cpu_us, data, reuse, stats);
+
+    worker_release(client, worker);
+    return status;
+}
+
+// Get the flight of a postal code, NULL if none is in progress. The client lock must be held.
+static Flight *flight_lookup(meteoswiss_client_t *client, int postal_code)
+{
+    for (Flight *flight = client->flights; flight; flight = flight->next)
+    {
+        if (flight->postal_code == postal_code)
+        {
+            return flight;
+        }
+    }
+    return NULL;
+}
+
+// Remove a completed flight from the list of fetches in progress. The client lock must be held.
+static void flight_unlink(meteoswiss_client_t *client, Flight *flight)
+{
+    Flight **link = &client->flights;
+    while (*link != flight)
+    {
+        link = &(*link)->next;
+    }
+    *link = flight->next;
+}
+
+// Get a flight, reusing a spare one with its arrays if any. The client lock must be held.
+static Flight *flight_alloc(meteoswiss_client_t *client)
+{
+    Flight *flight = client->spare_flights;
+    if (flight == NULL)
+    {
+        return calloc(1, sizeof(Flight));
+    }
+
+    client->spare_flights = flight->next;
+    MeteoSwissData data = flight->data;
+    memset(flight, 0, sizeof(Flight));
+    flight->data = data;
+    return flight;
+}
+
+// Keep a completed flight for the next fetches. The client lock must be held.
+static void flight_release(meteoswiss_client_t *client, Flight *flight)
+{
+    flight->next = client->spare_flights;
+    client->spare_flights = flight;
+}
+
+// Wait for the fetch of another query and copy its result, into the arrays already in data if reuse is set
+static int flight_wait(meteoswiss_client_t *client, Flight *flight, MeteoSwissData *data, int reuse,
+                       unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    struct timespec deadline;
+    if (timeout_ms)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    // Called with the client lock held
+    flight->waiters++;
+    int timed_out = 0;
+    while (!flight->done && !timed_out)
+    {
+        if (timeout_ms)
+        {
+            timed_out = (pthread_cond_timedwait(&client->flight_done, &client->lock, &deadline) == ETIMEDOUT);
+        }
+        else
+        {
+            pthread_cond_wait(&client->flight_done, &client->lock);
+        }
+    }
+
+    int status = METEOSWISS_ERROR;
+    if (flight->done)
+    {
+        status = flight->status;
+        if (status == METEOSWISS_SUCCESS &&
+            (reuse ? meteoswiss_data_assign(data, &flight->data) : meteoswiss_data_copy(data, &flight->data)) != 0)
+        {
+            status = METEOSWISS_ERROR;
+        }
+        if (stats)
+        {
+            *stats = flight->stats;
+            stats->coalesced = 1;
+        }
+    }
+
+    // The last waiter of a completed flight releases it, the fetching query does if there is none
+    if (--flight->waiters == 0 && flight->done)
+    {
+        flight_release(client, flight);
+    }
+    return status;
+}
+
+int meteoswiss_client_query(meteoswiss_client_t *client, int postal_code, MeteoSwissData *data, unsigned int timeout_ms)
+{
+    return meteoswiss_client_query_ex(client, postal_code, data, timeout_ms, NULL);
+}
+
+int meteoswiss_client_query_ex(meteoswiss_client_t *client, int postal_code, MeteoSwissData *data,
+                               unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    return meteoswiss_client_query_priority(client, postal_code, METEOSWISS_PRIORITY_INTERACTIVE, data, timeout_ms,
+                                            stats);
+}
+
+// Query a postal code, joining the fetch of a concurrent query for it if any
+static int query(meteoswiss_client_t *client, int postal_code, MeteoSwissPriority priority, MeteoSwissData *data,
+                 int reuse, unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    if (stats)
+    {
+        memset(stats, 0, sizeof(MeteoSwissQueryStats));
+    }
+    if (client == NULL || data == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    // Join the fetch of a concurrent query for the same postal code, if any
+    pthread_mutex_lock(&client->lock);
+    Flight *flight = flight_lookup(client, postal_code);
+    if (flight)
+    {
+        // The fetch must not queue behind the background lane while an interactive query waits on it
+        if (priority == METEOSWISS_PRIORITY_INTERACTIVE && flight->priority != priority)
+        {
+            flight->priority = priority;
+            pthread_cond_broadcast(&client->rate_wake);
+        }
+        int status = flight_wait(client, flight, data, reuse, timeout_ms, stats);
+        pthread_mutex_unlock(&client->lock);
+        return status;
+    }
+
+    flight = flight_alloc(client);
+    if (flight)
+    {
+        flight->postal_code = postal_code;
+        flight->priority = priority;
+        flight->next = client->flights;
+        client->flights = flight;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    MeteoSwissQueryStats flight_stats;
+    memset(&flight_stats, 0, sizeof(MeteoSwissQueryStats));
+    int status =
+        fetch(client, postal_code, flight ? &flight->priority : &priority, data, reuse, timeout_ms, &flight_stats);
+    if (stats)
+    {
+        *stats = flight_stats;
+    }
+    if (flight == NULL)
+    {
+        return status;
+    }
+
+    // Hand a copy of the result to the queries that joined in the meantime
+    pthread_mutex_lock(&client->lock);
+    flight_unlink(client, flight);
+    flight->done = 1;
+    flight->status = status;
+    flight->stats = flight_stats;
+    if (flight->waiters > 0)
+    {
+        if (status == METEOSWISS_SUCCESS && meteoswiss_data_assign(&flight->data, data) != 0)
+        {
+            flight->status = METEOSWISS_ERROR;
+        }
+        pthread_cond_broadcast(&client->flight_done);
+    }
+    else
+    {
+        flight_release(client, flight);
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    return status;
+}
+
+int meteoswiss_client_query_priority(meteoswiss_client_t *client, int postal_code, MeteoSwissPriority priority,
+                                     MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    return query(client, postal_code, priority, data, 0, timeout_ms, stats);
+}
+
+int meteoswiss_client_query_into(meteoswiss_client_t *client, int postal_code, MeteoSwissPriority priority,
+                                 MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    return query(client, postal_code, priority, data, 1, timeout_ms, stats);
+}
+
+// Parse each response of a batch as soon as its transfer completes
+static void batch_callback(void *userp, size_t index, int status, HttpResponse *response)
+{
+    BatchContext *batch = (BatchContext *)userp;
+
+    if (response)
+    {
+        breaker_record_response(batch->client, batch->probe, status, response);
+    }
+    memset(&batch->data[index], 0, sizeof(MeteoSwissData));
+    parser_start(batch->stream, &batch->storage[index].hint);
+    status = handle_response(batch->client, batch->postal_codes[index], status, response, batch->stream, 0, 0,
+                             &batch->data[index], 0, NULL);
+
+    if (status != METEOSWISS_SUCCESS)
+    {
+        batch->failures++;
+    }
+    if (batch->status)
+    {
+        batch->status[index] = status;
+    }
+}
+
+int meteoswiss_client_query_batch(meteoswiss_client_t *client, const int *postal_codes, size_t count,
+                                  MeteoSwissData *data, int *status, size_t max_in_flight, unsigned int timeout_ms)
+{
+    if (client == NULL || postal_codes == NULL || data == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+    if (count == 0)
+    {
+        return METEOSWISS_SUCCESS;
+    }
+    if (max_in_flight == 0)
+    {
+        max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+    }
+
+    // The breaker is checked again before each group of requests, this first
+    // request may be the probe of a half-open breaker
+    int probe;
+    int result = breaker_admit(client, &probe);
+    QueryWorker *worker = (result == METEOSWISS_SUCCESS) ? worker_acquire(client) : NULL;
+    if (worker == NULL)
+    {
+        breaker_abandon(client, probe);
+        if (result == METEOSWISS_SUCCESS)
+        {
+            result = METEOSWISS_ERROR;
+        }
+        memset(data, 0, count * sizeof(MeteoSwissData));
+        for (size_t i = 0; status && i < count; i++)
+        {
+            status[i] = result;
+        }
+        return result;
+    }
+
+    // All the requests and their URLs in a single allocation
+    HttpRequest *requests = malloc(count * (sizeof(HttpRequest) + sizeof(PlzRequest)));
+    if (requests == NULL)
+    {
+        breaker_abandon(client, probe);
+        worker_release(client, worker);
+        return METEOSWISS_ERROR;
+    }
+    PlzRequest *storage = (PlzRequest *)(requests + count);
+    char resolve_entry[RESOLVE_ENTRY_SIZE];
+    const char *resolve = resolve_snapshot(client, resolve_entry);
+    for (size_t i = 0; i < count; i++)
+    {
+        prepare_request(client, postal_codes[i], resolve, &storage[i], &requests[i]);
+    }
+
+    // With a rate limit, the requests are sent in groups of at most the burst,
+    // each one once the bucket holds enough tokens for it. With a breaker, in
+    // groups of at most its window, so that a batch stops soon after it opens.
+    size_t group = count;
+    if (client->config.rate_limit > 0 && group > client->config.rate_burst)
+    {
+        group = client->config.rate_burst;
+    }
+    if (client->config.breaker_failure_percent > 0 && group > BREAKER_WINDOW)
+    {
+        group = BREAKER_WINDOW;
+    }
+
+    const MeteoSwissPriority priority = METEOSWISS_PRIORITY_BACKGROUND;
+    size_t failures = 0;
+    size_t size;
+    for (size_t first = 0; first < count; first += size)
+    {
+        // The breaker opened during the batch, the remaining requests fail without being sent
+        if (first > 0 && breaker_admit(client, &probe) != METEOSWISS_SUCCESS)
+        {
+            memset(data + first, 0, (count - first) * sizeof(MeteoSwissData));
+            for (size_t i = first; status && i < count; i++)
+            {
+                status[i] = METEOSWISS_ERROR_CIRCUIT_OPEN;
+            }
+            failures += count - first;
+            break;
+        }
+
+        // The probe of a half-open breaker is a single request, the next group waits for its outcome
+        size = (count - first < group) ? count - first : group;
+        if (probe)
+        {
+            size = 1;
+        }
+
+        // A group waits for its tokens no longer than one of its requests may take. If
+        // they do not come in time, the next groups would not fare better.
+        long long deadline_ms = timeout_ms ? monotonic_ms() + timeout_ms : 0;
+        if (rate_acquire(client, &priority, (unsigned int)size, deadline_ms, NULL) != METEOSWISS_SUCCESS)
+        {
+            breaker_abandon(client, probe);
+            memset(data + first, 0, (count - first) * sizeof(MeteoSwissData));
+            for (size_t i = first; status && i < count; i++)
+            {
+                status[i] = METEOSWISS_ERROR_RATE_LIMITED;
+            }
+            failures += count - first;
+            break;
+        }
+
+        BatchContext batch = {client, postal_codes + first, storage + first, &worker->stream, data + first,
+                              status ? status + first : NULL, probe, 0};
+        if (worker->transport->ops->get_batch(worker->connection, requests + first, size, max_in_flight, timeout_ms,
+                                              batch_callback, &batch) != METEOSWISS_SUCCESS)
+        {
+            result = METEOSWISS_ERROR;
+        }
+        failures += batch.failures;
+        breaker_abandon(client, probe); // In case no transfer completed to resolve it
+    }
+    free(requests);
+    worker_release(client, worker);
+
+    if (result != METEOSWISS_SUCCESS || failures > 0)
+    {
+        return METEOSWISS_ERROR;
+    }
+    return METEOSWISS_SUCCESS;
+}
+
+int meteoswiss_query_ex(int postal_code, MeteoSwissData *data, unsigned int timeout_ms, MeteoSwissQueryStats *stats)
+{
+    if (stats)
+    {
+        memset(stats, 0, sizeof(MeteoSwissQueryStats));
+    }
+
+    meteoswiss_client_t *client = meteoswiss_client_create(NULL);
+    if (client == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    int result = meteoswiss_client_query_ex(client, postal_code, data, timeout_ms, stats);
+
+    meteoswiss_client_destroy(client);
+    return result;
+}
+
+int meteoswiss_query_batch(const int *postal_codes, size_t count, MeteoSwissData *data, int *status,
+                           size_t max_in_flight, unsigned int timeout_ms)
+{
+    meteoswiss_client_t *client = meteoswiss_client_create(NULL);
+    if (client == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    int result = meteoswiss_client_query_batch(client, postal_codes, count, data, status, max_in_flight, timeout_ms);
+
+    meteoswiss_client_destroy(client);
+    return result;
+}
+
+meteoswiss_async_t *meteoswiss_async_create(const MeteoSwissClientConfig *config,
+                                            meteoswiss_socket_callback socket_callback,
+                                            meteoswiss_timer_callback timer_callback, void *userp)
+{
+    meteoswiss_async_t *async = calloc(1, sizeof(meteoswiss_async_t));
+    if (async == NULL)
+    {
+        return NULL;
+    }
+
+    async->client = meteoswiss_client_create(config);
+    if (async->client == NULL)
+    {
+        free(async);
+        return NULL;
+    }
+
+    meteoswiss_share_t *share = async->client->config.share;
+    async->http = http_async_create(&async->client->config, share ? share->http : NULL, socket_callback,
+                                    timer_callback, userp);
+    if (async->http == NULL)
+    {
+        meteoswiss_client_destroy(async->client);
+        free(async);
+        return NULL;
+    }
+    return async;
+}
+
+void meteoswiss_async_destroy(meteoswiss_async_t *async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+
+    // Completes the queries in progress, their callbacks still need the client
+    http_async_destroy(async->http);
+    meteoswiss_client_destroy(async->client);
+    free(async);
+}
+
+// Feed the incremental parser of an asynchronous query with the body as it downloads
+static int async_stream_sink(void *userp, const char *data, size_t size)
+{
+    AsyncQuery *query = (AsyncQuery *)userp;
+
+    long long start_us = meteoswiss_cpu_time_us();
+    int result = plzdetail_stream_feed(&query->stream, data, size);
+    query->stream_cpu_us += meteoswiss_cpu_time_us() - start_us;
+    return result;
+}
+
+static void async_complete(void *userp, int status, HttpResponse *response)
+{
+    AsyncQuery *query = (AsyncQuery *)userp;
+    meteoswiss_async_t *async = query->async;
+
+    MeteoSwissData data;
+    MeteoSwissQueryStats stats;
+    memset(&data, 0, sizeof(data));
+    memset(&stats, 0, sizeof(stats));
+    stats.attempts = 1;
+
+    if (response)
+    {
+        breaker_record_response(async->client, query->probe, status, response);
+    }
+    else
+    {
+        breaker_abandon(async->client, query->probe);
+    }
+    status = handle_response(async->client, query->postal_code, response ? status : METEOSWISS_ERROR, response,
+                             &query->stream, query->streaming, query->stream_cpu_us, &data, 0, &stats);
+    async->running--;
+
+    meteoswiss_query_callback callback = query->callback;
+    void *callback_userp = query->userp;
+    int postal_code = query->postal_code;
+    plzdetail_stream_free(&query->stream);
+    free(query);
+
+    callback(callback_userp, postal_code, status, status == METEOSWISS_SUCCESS ? &data : NULL, &stats);
+}
+
+int meteoswiss_async_query(meteoswiss_async_t *async, int postal_code, unsigned int timeout_ms,
+                           meteoswiss_query_callback callback, void *userp)
+{
+    if (async == NULL || callback == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    int probe;
+    int status = breaker_admit(async->client, &probe);
+    if (status != METEOSWISS_SUCCESS)
+    {
+        return status;
+    }
+
+    AsyncQuery *query = calloc(1, sizeof(AsyncQuery));
+    if (query == NULL)
+    {
+        breaker_abandon(async->client, probe);
+        return METEOSWISS_ERROR;
+    }
+    query->async = async;
+    query->postal_code = postal_code;
+    query->callback = callback;
+    query->userp = userp;
+    query->probe = probe;
+    plzdetail_stream_init(&query->stream);
+
+    PlzRequest storage;
+    HttpRequest request;
+    char resolve[RESOLVE_ENTRY_SIZE];
+    prepare_request(async->client, postal_code, resolve_snapshot(async->client, resolve), &storage, &request);
+    parser_start(&query->stream, &storage.hint);
+    if (async->client->config.streaming_parse)
+    {
+        query->streaming = 1;
+        request.sink = async_stream_sink;
+        request.sink_userp = query;
+    }
+
+    if (http_async_get(async->http, &request, timeout_ms, async_complete, query) != METEOSWISS_SUCCESS)
+    {
+        breaker_abandon(async->client, probe);
+        plzdetail_stream_free(&query->stream);
+        free(query);
+        return METEOSWISS_ERROR;
+    }
+    async->running++;
+    return METEOSWISS_SUCCESS;
+}
+
+int meteoswiss_async_socket_action(meteoswiss_async_t *async, int fd, int events)
+{
+    return async ? http_async_socket_action(async->http, fd, events) : METEOSWISS_ERROR;
+}
+
+int meteoswiss_async_timeout(meteoswiss_async_t *async)
+{
+    return async ? http_async_timeout(async->http) : METEOSWISS_ERROR;
+}
+
+size_t meteoswiss_async_running(const meteoswiss_async_t *async)
+{
+    return async ? async->running : 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef METEOSWISS_INTERNAL_H
+#define METEOSWISS_INTERNAL_H
+
+#include "meteoswiss.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METEOSWISS_BASE_URL "https://app-prod-ws.meteoswiss-app.ch"
+#define METEOSWISS_PLZ_PATH "/v1/plzDetail?plz="
+#define PLZ_FORMAT_STRING "%04d00"
+#define PLZ_LENGTH 6
+
+// Longest base URL a client accepts, including the null-terminator
+#define METEOSWISS_BASE_URL_SIZE 192
+#define METEOSWISS_URL_SIZE (METEOSWISS_BASE_URL_SIZE + sizeof(METEOSWISS_PLZ_PATH) + PLZ_LENGTH)
+
+// Requested with HEAD to open connections ahead of the first query
+#define METEOSWISS_WARM_PATH "/v1/plzDetail"
+
+/**
+ * @brief Writes the plzDetail URL for a postal code.
+ *
+ * @param url Buffer receiving the URL, at least METEOSWISS_URL_SIZE bytes.
+ * @param url_size The size of the URL buffer.
+ * @param base_url The service URL without a trailing slash, NULL for METEOSWISS_BASE_URL.
+ * @param postal_code The postal code to query.
+ */
+void meteoswiss_format_url(char *url, size_t url_size, const char *base_url, int postal_code);
+
+/**
+ * @brief Parses and validates a plzDetail JSON response.
+ *
+ * Scans the response once, validating it and writing the values straight into
+ * the result, see plzdetail_parse().
+ *
+ * @param response The raw JSON response.
+ * @param length The length of the response in bytes.
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param stats Optional structure receiving the CPU time of the parse, may be NULL.
+ * @return 0 on success, non-zero on failure.
+ */
+int meteoswiss_parse_response(const char *response, size_t length, MeteoSwissData *data, MeteoSwissQueryStats *stats);
+
+/**
+ * @brief Parses and validates a plzDetail JSON response through the json.h DOM.
+ *
+ * Reference for the single-pass parser, which must accept the same documents
+ * and extract the same data. Only the parser benchmark calls it, queries go
+ * through meteoswiss_parse_response(). The DOM is walked once, checking the
+ * required keys while extracting the values.
+ *
+ * @param response The raw JSON response.
+ * @param length The length of the response in bytes.
+ * @param data Pointer to a MeteoSwissData structure to store the result.
+ * @param stats Optional structure receiving the CPU time of the parse and of
+ *              the walk together, in parse_us, may be NULL.
+ * @return 0 on success, non-zero on failure.
+ */
+int meteoswiss_parse_response_dom(const char *response, size_t length, MeteoSwissData *data,
+                                  MeteoSwissQueryStats *stats);
+
+/**
+ * @brief CPU time consumed by the calling thread.
+ *
+ * @return The CPU time in microseconds, or the monotonic time where per-thread
+ *         CPU time is not available.
+ */
+long long meteoswiss_cpu_time_us(void);
+
+/**
+ * @brief Deep copies weather data.
+ *
+ * @param dest Structure receiving the copy, to be freed with meteoswiss_data_free().
+ * @param src The data to copy.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int meteoswiss_data_copy(MeteoSwissData *dest, const MeteoSwissData *src);
+
+/**
+ * @brief Copies weather data into the arrays of existing data.
+ *
+ * The arrays of dest only grow when they are too small for src. On failure,
+ * dest keeps its arrays and can still be freed with meteoswiss_data_free().
+ *
+ * @param dest Data whose arrays receive the copy, zeroed or holding a previous result.
+ * @param src The data to copy.
+ * @return 0 on success, non-zero on allocation failure.
+ */
+int meteoswiss_data_assign(MeteoSwissData *dest, const MeteoSwissData *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METEOSWISS_INTERNAL_H
@@ -0,0 +1,163 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "plzdetail_keys.h"
+#include "json.h"
+#include <stdint.h>
+#include <string.h>
+
+#define KEY_COUNT(keys) (sizeof(keys) / sizeof(keys[0]))
+#define FNV_PRIME 16777619u
+#define KEY(name) {name, sizeof(name) - 1}
+
+// A known key with its length, compared first so that most misses skip the memcmp()
+typedef struct
+{
+    const char *name;
+    size_t length;
+} PlzKey;
+
+static const PlzKey root_keys[] = {
+    KEY("currentWeather"),
+    KEY("forecast"),
+    KEY("warnings"),
+    KEY("warningsOverview"),
+    KEY("graph")
+};
+
+static const PlzKey current_keys[] = {
+    KEY("time"),
+    KEY("icon"),
+    KEY("iconV2"),
+    KEY("temperature")
+};
+
+static const PlzKey entry_keys[] = {
+    KEY("dayDate"),
+    KEY("iconDay"),
+    KEY("iconDayV2"),
+    KEY("temperatureMax"),
+    KEY("temperatureMin"),
+    KEY("precipitation"),
+    KEY("precipitationMin"),
+    KEY("precipitationMax")
+};
+
+static const PlzKey graph_keys[] = {
+    KEY("start"),
+    KEY("startLowResolution"),
+    KEY("precipitation10m"),
+    KEY("precipitationMin10m"),
+    KEY("precipitationMax10m"),
+    KEY("weatherIcon3h"),
+    KEY("weatherIcon3hV2"),
+    KEY("windDirection3h"),
+    KEY("windSpeed3h"),
+    KEY("sunrise"),
+    KEY("sunset"),
+    KEY("temperatureMin1h"),
+    KEY("temperatureMax1h"),
+    KEY("temperatureMean1h"),
+    KEY("precipitation1h"),
+    KEY("precipitationMin1h"),
+    KEY("precipitationMax1h"),
+    KEY("windSpeed1h"),
+    KEY("windSpeed1hq10"),
+    KEY("windSpeed1hq90"),
+    KEY("gustSpeed1h"),
+    KEY("gustSpeed1hq10"),
+    KEY("gustSpeed1hq90"),
+    KEY("sunshine1h"),
+    KEY("precipitationProbability3h")
+};
+
+// The enumerations of the header must match the tables
+typedef char root_keys_match[KEY_COUNT(root_keys) == ROOT_KEY_COUNT ? 1 : -1];
+typedef char current_keys_match[KEY_COUNT(current_keys) == CURRENT_KEY_COUNT ? 1 : -1];
+typedef char entry_keys_match[KEY_COUNT(entry_keys) == ENTRY_KEY_COUNT ? 1 : -1];
+typedef char graph_keys_match[KEY_COUNT(graph_keys) == GRAPH_KEY_COUNT ? 1 : -1];
+
+// A key hashes to the slot given by the top bits of its FNV-1a hash. The seed
+// of each set is the first one from the FNV offset basis for which the keys of
+// the set land in distinct slots of a table at least twice their number.
+// Slots hold the index of their key plus one, 0 for an empty slot.
+static const unsigned char root_slots[16] = {0, 0, 0, 1, 5, 0, 0, 3, 0, 0, 0, 4, 0, 2, 0, 0};
+static const unsigned char current_slots[8] = {0, 4, 1, 0, 0, 3, 2, 0};
+static const unsigned char entry_slots[16] = {0, 8, 1, 5, 0, 4, 2, 0, 0, 0, 6, 3, 0, 0, 0, 7};
+static const unsigned char graph_slots[64] = {
+    0, 0, 0, 6, 0, 0, 0, 0, 13, 5, 17, 0, 2, 9, 18, 0,
+    0, 0, 23, 4, 16, 0, 0, 0, 10, 0, 0, 0, 0, 12, 0, 8,
+    0, 21, 20, 0, 0, 0, 19, 0, 11, 0, 0, 0, 0, 0, 0, 0,
+    0, 24, 0, 15, 0, 0, 22, 25, 0, 3, 0, 7, 0, 0, 1, 14
+};
+
+typedef struct
+{
+    const PlzKey *keys;
+    size_t count;
+    uint32_t seed;
+    unsigned int bits;           // Number of slots as a power of two
+    const unsigned char *slots;
+} KeyTable;
+
+// Indexed by PlzKeySet
+static const KeyTable key_tables[] = {
+    {root_keys, ROOT_KEY_COUNT, 0x811c9dc7u, 4, root_slots},
+    {current_keys, CURRENT_KEY_COUNT, 0x811c9dc9u, 3, current_slots},
+    {entry_keys, ENTRY_KEY_COUNT, 0x811c9dd1u, 4, entry_slots},
+    {graph_keys, GRAPH_KEY_COUNT, 0x811c9dd7u, 6, graph_slots}
+};
+
+int plzdetail_key_find(PlzKeySet set, const char *text, size_t length)
+{
+    const KeyTable *table = &key_tables[set];
+
+    uint32_t hash = table->seed;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= FNV_PRIME;
+    }
+
+    // Unknown keys may hash to the slot of a known one, the key itself decides
+    int index = table->slots[hash >> (32 - table->bits)] - 1;
+    if (index < 0 || table->keys[index].length != length || memcmp(table->keys[index].name, text, length) != 0)
+    {
+        return PLZ_KEY_NONE;
+    }
+    return index;
+}
+
+unsigned long plzdetail_object_members(struct json_object_s *object, PlzKeySet set, struct json_value_s **values)
+{
+    unsigned long seen = 0;
+    memset(values, 0, key_tables[set].count * sizeof(struct json_value_s *));
+
+    for (struct json_object_element_s *element = object->start; element; element = element->next)
+    {
+        int index = plzdetail_key_find(set, element->name->string, element->name->string_size);
+        if (index != PLZ_KEY_NONE && !(seen & (1ul << index)))
+        {
+            seen |= 1ul << index;
+            values[index] = element->value;
+        }
+    }
+    return seen;
+}
@@ -0,0 +1,116 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLZDETAIL_KEYS_H
+#define PLZDETAIL_KEYS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct json_object_s;
+struct json_value_s;
+
+#define PLZ_KEY_NONE -1
+
+/**
+ * @brief Objects of a plzDetail response, each with its own set of known keys.
+ */
+typedef enum {
+    PLZ_KEYS_ROOT,
+    PLZ_KEYS_CURRENT,
+    PLZ_KEYS_ENTRY,
+    PLZ_KEYS_GRAPH
+} PlzKeySet;
+
+// Keys of the root object, all required
+enum {
+    ROOT_CURRENT_WEATHER,
+    ROOT_FORECAST,
+    ROOT_WARNINGS,
+    ROOT_WARNINGS_OVERVIEW,
+    ROOT_GRAPH,
+    ROOT_KEY_COUNT
+};
+
+// Keys of currentWeather, all required
+enum {
+    CURRENT_TIME,
+    CURRENT_ICON,
+    CURRENT_ICON_V2,
+    CURRENT_TEMPERATURE,
+    CURRENT_KEY_COUNT
+};
+
+// Keys of a forecast entry, all required
+enum {
+    ENTRY_DAY_DATE,
+    ENTRY_ICON_DAY,
+    ENTRY_ICON_DAY_V2,
+    ENTRY_TEMPERATURE_MAX,
+    ENTRY_TEMPERATURE_MIN,
+    ENTRY_PRECIPITATION,
+    ENTRY_PRECIPITATION_MIN,
+    ENTRY_PRECIPITATION_MAX,
+    ENTRY_KEY_COUNT
+};
+
+// Keys of graph, all required, the ones from GRAPH_FIRST_ARRAY on must hold arrays
+enum {
+    GRAPH_START,
+    GRAPH_START_LOW_RESOLUTION,
+    GRAPH_PRECIPITATION_10M,
+    GRAPH_FIRST_ARRAY = GRAPH_PRECIPITATION_10M,
+    GRAPH_KEY_COUNT = 25
+};
+
+// Mask with a bit set for each of count keys
+#define PLZ_ALL_KEYS(count) ((1ul << (count)) - 1)
+
+/**
+ * @brief Find a key in a set with a perfect hash.
+ *
+ * @param set The object the key belongs to.
+ * @param text The key, not null-terminated.
+ * @param length The length of the key.
+ * @return The index of the key in its set, PLZ_KEY_NONE if it is unknown.
+ */
+int plzdetail_key_find(PlzKeySet set, const char *text, size_t length);
+
+/**
+ * @brief Sort the members of a json.h object by key in a single pass.
+ *
+ * Like for the incremental parser, only the first occurrence of a key counts.
+ *
+ * @param object The object.
+ * @param set The keys of the object.
+ * @param values Receives the value of each known key, indexed like the set,
+ *               NULL for the missing ones.
+ * @return A mask with the bits of the keys found set.
+ */
+unsigned long plzdetail_object_members(struct json_object_s *object, PlzKeySet set, struct json_value_s **values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLZDETAIL_KEYS_H
@@ -0,0 +1,527 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "plzdetail_stream.h"
+#include "plzdetail_keys.h"
+#include "json_number.h"
+#include "meteoswiss.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Where in the document the parser is
+enum {
+    POS_DOCUMENT,       // Before the root object
+    POS_ROOT,           // In the root object, before a key
+    POS_ROOT_VALUE,     // In the root object, before a value
+    POS_CURRENT,        // In currentWeather, before a key
+    POS_CURRENT_VALUE,  // In currentWeather, before a value
+    POS_FORECAST,       // In the forecast array
+    POS_ENTRY,          // In a forecast entry, before a key
+    POS_ENTRY_VALUE,    // In a forecast entry, before a value
+    POS_GRAPH,          // In graph, before a key
+    POS_GRAPH_VALUE,    // In graph, before a value
+    POS_PRECIPITATION,  // In graph.precipitation10m
+    POS_END             // After the root object
+};
+
+#define FIELD_NONE PLZ_KEY_NONE
+
+#define FORECAST_INITIAL_CAPACITY 8
+#define PRECIPITATION_INITIAL_CAPACITY 64
+
+// Find a key of a set, FIELD_NONE if it is unknown or was already seen
+static int find_key(PlzKeySet set, unsigned long *seen, const char *text, size_t length)
+{
+    int index = plzdetail_key_find(set, text, length);
+
+    // Like the DOM parser, only the first occurrence of a key counts
+    if (index == PLZ_KEY_NONE || (*seen & (1ul << index)))
+    {
+        return FIELD_NONE;
+    }
+    *seen |= 1ul << index;
+    return index;
+}
+
+static int is_begin(JsonStreamEvent event)
+{
+    return event == JSON_STREAM_OBJECT_BEGIN || event == JSON_STREAM_ARRAY_BEGIN;
+}
+
+// Ignore a value, then continue at the given position
+static int skip_value(PlzDetailStream *stream, JsonStreamEvent event, int position)
+{
+    if (is_begin(event))
+    {
+        stream->skip_depth = 1;
+        stream->skip_return = position;
+    }
+    else
+    {
+        stream->position = position;
+    }
+    return 0;
+}
+
+static int add_forecast_entry(PlzDetailStream *stream)
+{
+    MeteoSwissData *data = &stream->data;
+
+    if (data->forecast_count == data->forecast_capacity)
+    {
+        size_t capacity = data->forecast_capacity ? data->forecast_capacity * 2 : FORECAST_INITIAL_CAPACITY;
+        ForecastEntry *forecast = realloc(data->forecast, capacity * sizeof(ForecastEntry));
+        if (forecast == NULL)
+        {
+            return -1;
+        }
+        data->forecast = forecast;
+        data->forecast_capacity = capacity;
+    }
+
+    memset(&data->forecast[data->forecast_count++], 0, sizeof(ForecastEntry));
+    return 0;
+}
+
+static int add_precipitation(PlzDetailStream *stream, float value)
+{
+    WeatherGraph *graph = &stream->data.graph;
+
+    if (graph->precipitation10m_count == graph->precipitation10m_capacity)
+    {
+        size_t capacity = graph->precipitation10m_capacity ? graph->precipitation10m_capacity * 2 : PRECIPITATION_INITIAL_CAPACITY;
+        float *array = realloc(graph->precipitation10m, capacity * sizeof(float));
+        if (array == NULL)
+        {
+            return -1;
+        }
+        graph->precipitation10m = array;
+        graph->precipitation10m_capacity = capacity;
+    }
+
+    graph->precipitation10m[graph->precipitation10m_count++] = value;
+    return 0;
+}
+
+static int root_value(PlzDetailStream *stream, JsonStreamEvent event)
+{
+    switch (stream->field)
+    {
+    case ROOT_CURRENT_WEATHER:
+        if (event != JSON_STREAM_OBJECT_BEGIN)
+        {
+            return -1;
+        }
+        stream->position = POS_CURRENT;
+        return 0;
+    case ROOT_FORECAST:
+        if (event != JSON_STREAM_ARRAY_BEGIN)
+        {
+            return -1;
+        }
+        stream->position = POS_FORECAST;
+        return 0;
+    case ROOT_WARNINGS:
+    case ROOT_WARNINGS_OVERVIEW:
+        // Required, but the content is not extracted
+        if (event != JSON_STREAM_ARRAY_BEGIN)
+        {
+            return -1;
+        }
+        return skip_value(stream, event, POS_ROOT);
+    case ROOT_GRAPH:
+        if (event != JSON_STREAM_OBJECT_BEGIN)
+        {
+            return -1;
+        }
+        stream->position = POS_GRAPH;
+        return 0;
+    default:
+        return skip_value(stream, event, POS_ROOT);
+    }
+}
+
+static int current_value(PlzDetailStream *stream, JsonStreamEvent event, const char *text, size_t length)
+{
+    CurrentWeather *current = &stream->data.currentWeather;
+
+    if (event != JSON_STREAM_NUMBER)
+    {
+        return skip_value(stream, event, POS_CURRENT);
+    }
+
+    switch (stream->field)
+    {
+    case CURRENT_TIME:
+        current->time = json_number_to_long_long(text, length);
+        break;
+    case CURRENT_ICON:
+        current->icon = json_number_to_int(text, length);
+        break;
+    case CURRENT_ICON_V2:
+        current->iconV2 = json_number_to_int(text, length);
+        break;
+    case CURRENT_TEMPERATURE:
+        current->temperature = (float)json_number_to_double(text, length);
+        break;
+    default:
+        break;
+    }
+    stream->position = POS_CURRENT;
+    return 0;
+}
+
+static int entry_value(PlzDetailStream *stream, JsonStreamEvent event, const char *text, size_t length)
+{
+    ForecastEntry *entry = &stream->data.forecast[stream->data.forecast_count - 1];
+
+    if (stream->field == ENTRY_DAY_DATE && event == JSON_STREAM_STRING)
+    {
+        size_t copy_size = (length < sizeof(entry->dayDate) - 1) ? length : sizeof(entry->dayDate) - 1;
+        memcpy(entry->dayDate, text, copy_size);
+        entry->dayDate[copy_size] = '\0';
+        stream->position = POS_ENTRY;
+        return 0;
+    }
+    if (event != JSON_STREAM_NUMBER)
+    {
+        return skip_value(stream, event, POS_ENTRY);
+    }
+
+    switch (stream->field)
+    {
+    case ENTRY_ICON_DAY:
+        entry->iconDay = json_number_to_int(text, length);
+        break;
+    case ENTRY_ICON_DAY_V2:
+        entry->iconDayV2 = json_number_to_int(text, length);
+        break;
+    case ENTRY_TEMPERATURE_MAX:
+        entry->temperatureMax = (float)json_number_to_double(text, length);
+        break;
+    case ENTRY_TEMPERATURE_MIN:
+        entry->temperatureMin = (float)json_number_to_double(text, length);
+        break;
+    case ENTRY_PRECIPITATION:
+        entry->precipitation = (float)json_number_to_double(text, length);
+        break;
+    case ENTRY_PRECIPITATION_MIN:
+        entry->precipitationMin = (float)json_number_to_double(text, length);
+        break;
+    case ENTRY_PRECIPITATION_MAX:
+        entry->precipitationMax = (float)json_number_to_double(text, length);
+        break;
+    default:
+        break;
+    }
+    stream->position = POS_ENTRY;
+    return 0;
+}
+
+static int graph_value(PlzDetailStream *stream, JsonStreamEvent event, const char *text, size_t length)
+{
+    WeatherGraph *graph = &stream->data.graph;
+
+    if (stream->field >= GRAPH_FIRST_ARRAY && event != JSON_STREAM_ARRAY_BEGIN)
+    {
+        return -1;
+    }
+
+    switch (stream->field)
+    {
+    case GRAPH_START:
+    case GRAPH_START_LOW_RESOLUTION:
+        if (event != JSON_STREAM_NUMBER)
+        {
+            return skip_value(stream, event, POS_GRAPH);
+        }
+        if (stream->field == GRAPH_START)
+        {
+            graph->start = json_number_to_long_long(text, length);
+        }
+        else
+        {
+            graph->startLowResolution = json_number_to_long_long(text, length);
+        }
+        stream->position = POS_GRAPH;
+        return 0;
+    case GRAPH_PRECIPITATION_10M:
+        stream->position = POS_PRECIPITATION;
+        return 0;
+    default:
+        return skip_value(stream, event, POS_GRAPH);
+    }
+}
+
+static int precipitation_value(PlzDetailStream *stream, JsonStreamEvent event, const char *text, size_t length)
+{
+    if (event == JSON_STREAM_ARRAY_END)
+    {
+        stream->position = POS_GRAPH;
+        return 0;
+    }
+
+    // Elements that are not numbers are kept as 0, like in the DOM parser
+    float value = (event == JSON_STREAM_NUMBER) ? (float)json_number_to_double(text, length) : 0.0f;
+    if (add_precipitation(stream, value) != 0)
+    {
+        return -1;
+    }
+    return skip_value(stream, event, POS_PRECIPITATION);
+}
+
+static int on_event(void *userp, JsonStreamEvent event, const char *text, size_t length)
+{
+    PlzDetailStream *stream = userp;
+
+    if (stream->skip_depth)
+    {
+        if (is_begin(event))
+        {
+            stream->skip_depth++;
+        }
+        else if (event == JSON_STREAM_OBJECT_END || event == JSON_STREAM_ARRAY_END)
+        {
+            if (--stream->skip_depth == 0)
+            {
+                stream->position = stream->skip_return;
+            }
+        }
+        return 0;
+    }
+
+    switch (stream->position)
+    {
+    case POS_DOCUMENT:
+        if (event != JSON_STREAM_OBJECT_BEGIN)
+        {
+            return -1;
+        }
+        stream->position = POS_ROOT;
+        return 0;
+
+    case POS_ROOT:
+        if (event == JSON_STREAM_OBJECT_END)
+        {
+            stream->position = POS_END;
+            return (stream->sections == PLZ_ALL_KEYS(ROOT_KEY_COUNT)) ? 0 : -1;
+        }
+        {
+            unsigned long seen = stream->sections;
+            stream->field = find_key(PLZ_KEYS_ROOT, &seen, text, length);
+            stream->sections = (unsigned int)seen;
+        }
+        stream->position = POS_ROOT_VALUE;
+        return 0;
+    case POS_ROOT_VALUE:
+        return root_value(stream, event);
+
+    case POS_CURRENT:
+        if (event == JSON_STREAM_OBJECT_END)
+        {
+            stream->position = POS_ROOT;
+            return (stream->current_keys == PLZ_ALL_KEYS(CURRENT_KEY_COUNT)) ? 0 : -1;
+        }
+        {
+            unsigned long seen = stream->current_keys;
+            stream->field = find_key(PLZ_KEYS_CURRENT, &seen, text, length);
+            stream->current_keys = (unsigned int)seen;
+        }
+        stream->position = POS_CURRENT_VALUE;
+        return 0;
+    case POS_CURRENT_VALUE:
+        return current_value(stream, event, text, length);
+
+    case POS_FORECAST:
+        if (event == JSON_STREAM_ARRAY_END)
+        {
+            stream->position = POS_ROOT;
+            return 0;
+        }
+        if (event != JSON_STREAM_OBJECT_BEGIN || add_forecast_entry(stream) != 0)
+        {
+            return -1;
+        }
+        stream->entry_keys = 0;
+        stream->position = POS_ENTRY;
+        return 0;
+    case POS_ENTRY:
+        if (event == JSON_STREAM_OBJECT_END)
+        {
+            stream->position = POS_FORECAST;
+            return (stream->entry_keys == PLZ_ALL_KEYS(ENTRY_KEY_COUNT)) ? 0 : -1;
+        }
+        {
+            unsigned long seen = stream->entry_keys;
+            stream->field = find_key(PLZ_KEYS_ENTRY, &seen, text, length);
+            stream->entry_keys = (unsigned int)seen;
+        }
+        stream->position = POS_ENTRY_VALUE;
+        return 0;
+    case POS_ENTRY_VALUE:
+        return entry_value(stream, event, text, length);
+
+    case POS_GRAPH:
+        if (event == JSON_STREAM_OBJECT_END)
+        {
+            stream->position = POS_ROOT;
+            return (stream->graph_keys == PLZ_ALL_KEYS(GRAPH_KEY_COUNT)) ? 0 : -1;
+        }
+        stream->field = find_key(PLZ_KEYS_GRAPH, &stream->graph_keys, text, length);
+        stream->position = POS_GRAPH_VALUE;
+        return 0;
+    case POS_GRAPH_VALUE:
+        return graph_value(stream, event, text, length);
+    case POS_PRECIPITATION:
+        return precipitation_value(stream, event, text, length);
+
+    default:
+        return -1;
+    }
+}
+
+void plzdetail_stream_init(PlzDetailStream *stream)
+{
+    memset(stream, 0, sizeof(PlzDetailStream));
+    json_stream_init(&stream->json, on_event, stream);
+    plzdetail_stream_reset(stream);
+}
+
+void plzdetail_stream_reset(PlzDetailStream *stream)
+{
+    // Keep the arrays for the next response, only their content goes
+    MeteoSwissData *data = &stream->data;
+    ForecastEntry *forecast = data->forecast;
+    size_t forecast_capacity = data->forecast_capacity;
+    float *precipitation10m = data->graph.precipitation10m;
+    size_t precipitation10m_capacity = data->graph.precipitation10m_capacity;
+    memset(data, 0, sizeof(MeteoSwissData));
+    data->forecast = forecast;
+    data->forecast_capacity = forecast_capacity;
+    data->graph.precipitation10m = precipitation10m;
+    data->graph.precipitation10m_capacity = precipitation10m_capacity;
+    json_stream_reset(&stream->json);
+
+    stream->position = POS_DOCUMENT;
+    stream->field = FIELD_NONE;
+    stream->skip_depth = 0;
+    stream->sections = 0;
+    stream->current_keys = 0;
+    stream->entry_keys = 0;
+    stream->graph_keys = 0;
+}
+
+void plzdetail_stream_reserve(PlzDetailStream *stream, size_t forecast_count, size_t precipitation_count)
+{
+    MeteoSwissData *data = &stream->data;
+
+    if (forecast_count > data->forecast_capacity)
+    {
+        ForecastEntry *forecast = realloc(data->forecast, forecast_count * sizeof(ForecastEntry));
+        if (forecast)
+        {
+            data->forecast = forecast;
+            data->forecast_capacity = forecast_count;
+        }
+    }
+    if (precipitation_count > data->graph.precipitation10m_capacity)
+    {
+        float *array = realloc(data->graph.precipitation10m, precipitation_count * sizeof(float));
+        if (array)
+        {
+            data->graph.precipitation10m = array;
+            data->graph.precipitation10m_capacity = precipitation_count;
+        }
+    }
+}
+
+int plzdetail_stream_feed(PlzDetailStream *stream, const char *data, size_t size)
+{
+    return json_stream_feed(&stream->json, data, size);
+}
+
+int plzdetail_stream_finish(PlzDetailStream *stream, MeteoSwissData *data)
+{
+    if (json_stream_finish(&stream->json) != 0 || stream->position != POS_END)
+    {
+        plzdetail_stream_reset(stream);
+        return -1;
+    }
+
+    // Arrays reserved for entries that did not come are not handed over
+    if (stream->data.forecast_count == 0)
+    {
+        free(stream->data.forecast);
+        stream->data.forecast = NULL;
+        stream->data.forecast_capacity = 0;
+    }
+    if (stream->data.graph.precipitation10m_count == 0)
+    {
+        free(stream->data.graph.precipitation10m);
+        stream->data.graph.precipitation10m = NULL;
+        stream->data.graph.precipitation10m_capacity = 0;
+    }
+
+    // Hand over the arrays, the parser allocates new ones for the next response
+    *data = stream->data;
+    memset(&stream->data, 0, sizeof(MeteoSwissData));
+    plzdetail_stream_reset(stream);
+    return 0;
+}
+
+int plzdetail_stream_finish_into(PlzDetailStream *stream, MeteoSwissData *data)
+{
+    if (json_stream_finish(&stream->json) != 0 || stream->position != POS_END)
+    {
+        plzdetail_stream_reset(stream);
+        return -1;
+    }
+
+    // Swap the arrays, the previous ones of the caller receive the next response
+    MeteoSwissData result = stream->data;
+    stream->data.forecast = data->forecast;
+    stream->data.forecast_capacity = data->forecast_capacity;
+    stream->data.graph.precipitation10m = data->graph.precipitation10m;
+    stream->data.graph.precipitation10m_capacity = data->graph.precipitation10m_capacity;
+    *data = result;
+    plzdetail_stream_reset(stream);
+    return 0;
+}
+
+void plzdetail_stream_free(PlzDetailStream *stream)
+{
+    meteoswiss_data_free(&stream->data);
+    json_stream_free(&stream->json);
+}
+
+int plzdetail_parse(const char *response, size_t length, MeteoSwissData *data)
+{
+    PlzDetailStream stream;
+    plzdetail_stream_init(&stream);
+
+    int result = plzdetail_stream_feed(&stream, response, length);
+    if (result == 0)
+    {
+        result = plzdetail_stream_finish(&stream, data);
+    }
+
+    plzdetail_stream_free(&stream);
+    return result;
+}
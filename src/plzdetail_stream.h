@@ -0,0 +1,139 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLZDETAIL_STREAM_H
+#define PLZDETAIL_STREAM_H
+
+#include "meteoswiss.h"
+#include "json_stream.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Incremental parser for plzDetail responses.
+ *
+ * Consumes the response chunk by chunk as it is downloaded, validating the
+ * document and extracting the weather data on the fly, so parsing overlaps
+ * the transfer and no DOM is built. Accepts and rejects the same documents as
+ * meteoswiss_parse_response_dom().
+ */
+typedef struct {
+    JsonStream json;
+    MeteoSwissData data;  // Data extracted so far
+
+    int position;         // Where in the document the parser is
+    int field;            // Field whose value comes next
+    size_t skip_depth;    // Nesting of the value being skipped, 0 if none
+    int skip_return;      // Position to return to once the value is skipped
+
+    unsigned int sections;     // Sections of the root object found
+    unsigned int current_keys; // Keys of currentWeather found
+    unsigned int entry_keys;   // Keys of the current forecast entry found
+    unsigned long graph_keys;  // Keys of graph found
+} PlzDetailStream;
+
+/**
+ * @brief Initialize a parser.
+ *
+ * @param stream The parser.
+ */
+void plzdetail_stream_init(PlzDetailStream *stream);
+
+/**
+ * @brief Prepare a parser for a new response, keeping its buffers.
+ *
+ * The data extracted so far is dropped, but its arrays stay allocated and
+ * receive the next response.
+ *
+ * @param stream The parser.
+ */
+void plzdetail_stream_reset(PlzDetailStream *stream);
+
+/**
+ * @brief Allocate the arrays of the next response upfront.
+ *
+ * Best effort, the arrays still grow on demand if this fails.
+ *
+ * @param stream The parser, just reset.
+ * @param forecast_count The expected number of forecast entries.
+ * @param precipitation_count The expected number of precipitation values.
+ */
+void plzdetail_stream_reserve(PlzDetailStream *stream, size_t forecast_count, size_t precipitation_count);
+
+/**
+ * @brief Feed the next chunk of the response.
+ *
+ * @param stream The parser.
+ * @param data The chunk.
+ * @param size The size of the chunk.
+ * @return 0 on success, non-zero if the response is invalid.
+ */
+int plzdetail_stream_feed(PlzDetailStream *stream, const char *data, size_t size);
+
+/**
+ * @brief Complete the response and hand over the extracted data.
+ *
+ * @param stream The parser.
+ * @param data Structure receiving the data on success.
+ * @return 0 on success, non-zero if the response is incomplete or invalid.
+ */
+int plzdetail_stream_finish(PlzDetailStream *stream, MeteoSwissData *data);
+
+/**
+ * @brief Complete the response and swap the extracted data with a previous result.
+ *
+ * The arrays of data go to the parser for the next response, in place of the
+ * ones handed over, so neither side allocates once both are large enough.
+ * Arrays are handed over even when their count is 0.
+ *
+ * @param stream The parser.
+ * @param data Structure holding a previous result or zeroed, receiving the data on success.
+ * @return 0 on success, non-zero if the response is incomplete or invalid.
+ */
+int plzdetail_stream_finish_into(PlzDetailStream *stream, MeteoSwissData *data);
+
+/**
+ * @brief Release the memory held by a parser.
+ *
+ * @param stream The parser.
+ */
+void plzdetail_stream_free(PlzDetailStream *stream);
+
+/**
+ * @brief Parse a complete plzDetail response in a single pass.
+ *
+ * The whole response is one chunk, so the tokens are read in place and only
+ * strings with escape sequences are copied.
+ *
+ * @param response The raw JSON response.
+ * @param length The length of the response in bytes.
+ * @param data Structure receiving the data on success.
+ * @return 0 on success, non-zero if the response is invalid.
+ */
+int plzdetail_parse(const char *response, size_t length, MeteoSwissData *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLZDETAIL_STREAM_H
@@ -0,0 +1,88 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "transport.h"
+#include <stdlib.h>
+
+// The platform HTTP backend, selected at compile time
+static void *default_open(void *state, const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    (void)state;
+    return http_client_create(config, share);
+}
+
+static void default_close(void *connection)
+{
+    http_client_destroy((http_client_t *)connection);
+}
+
+static int default_warm(void *connection, const char *url, unsigned int timeout_ms)
+{
+    return http_client_warm((http_client_t *)connection, url, timeout_ms);
+}
+
+static int default_get(void *connection, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    return http_client_get((http_client_t *)connection, request, response, timeout_ms);
+}
+
+static int default_get_hedged(void *connection, const HttpRequest *request, HttpResponse *response,
+                              unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    return http_client_get_hedged((http_client_t *)connection, request, response, timeout_ms, hedge_delay_ms, hedged);
+}
+
+static int default_get_batch(void *connection, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                             unsigned int timeout_ms, http_batch_callback callback, void *userp)
+{
+    return http_client_get_batch((http_client_t *)connection, requests, count, max_in_flight,
+                                 timeout_ms, callback, userp);
+}
+
+static const TransportOps default_ops = {
+    default_open,
+    default_close,
+    default_warm,
+    default_get,
+    default_get_hedged,
+    default_get_batch,
+    NULL
+};
+
+static meteoswiss_transport_t default_transport = {&default_ops, NULL};
+
+meteoswiss_transport_t *transport_default(void)
+{
+    return &default_transport;
+}
+
+void meteoswiss_transport_destroy(meteoswiss_transport_t *transport)
+{
+    if (transport == NULL || transport == &default_transport)
+    {
+        return;
+    }
+
+    if (transport->ops->destroy)
+    {
+        transport->ops->destroy(transport->state);
+    }
+    free(transport);
+}
@@ -0,0 +1,68 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "meteoswiss.h"
+#include "http_client.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Function table of a transport, mirroring the persistent HTTP client API.
+ *
+ * A connection is the equivalent of an http_client_t, each client worker opens
+ * its own and uses it from one thread at a time. The state is shared by every
+ * connection of the transport.
+ */
+typedef struct {
+    void *(*open)(void *state, const MeteoSwissClientConfig *config, http_share_t *share);
+    void (*close)(void *connection);
+    int (*warm)(void *connection, const char *url, unsigned int timeout_ms); // NULL if there is nothing to open
+    int (*get)(void *connection, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms);
+    int (*get_hedged)(void *connection, const HttpRequest *request, HttpResponse *response,
+                      unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged);
+    int (*get_batch)(void *connection, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                     unsigned int timeout_ms, http_batch_callback callback, void *userp);
+    void (*destroy)(void *state);
+} TransportOps;
+
+struct meteoswiss_transport
+{
+    const TransportOps *ops;
+    void *state;
+};
+
+/**
+ * @brief The transport of the platform HTTP backend, used when none is configured.
+ *
+ * @return The default transport, never destroyed.
+ */
+meteoswiss_transport_t *transport_default(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSPORT_H
@@ -0,0 +1,650 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "transport.h"
+#include "meteoswiss_internal.h"
+#include <stdlib.h>
+
+#if HTTP_WRAPPER_DESKTOP == 1
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORD_EXTENSION ".http"
+#define RECORD_KEY_SIZE METEOSWISS_URL_SIZE // Any URL of a client fits, with the extension in a file name
+#define RECORD_PATH_SIZE 4096
+#define RECORD_LINE_SIZE 512
+
+// The name of a recording must fit in a directory entry
+typedef char record_name_fits[RECORD_KEY_SIZE - 1 + sizeof(RECORD_EXTENSION) - 1 <= 255 ? 1 : -1];
+
+// One recorded response, mapped in memory
+typedef struct
+{
+    char key[RECORD_KEY_SIZE];
+    void *map;
+    size_t map_size;
+    const char *body; // Points into the mapping
+    size_t body_length;
+    long status_code;
+    char etag[HTTP_VALIDATOR_SIZE];
+    char last_modified[HTTP_VALIDATOR_SIZE];
+    HttpTimings timings;
+} ReplayEntry;
+
+typedef struct
+{
+    ReplayEntry *entries; // Sorted by key
+    size_t count;
+    int simulate_latency;
+} ReplayerState;
+
+typedef struct
+{
+    ReplayerState *state;
+    HttpResponse response; // Response of the batch transfer in progress
+} ReplayerConnection;
+
+typedef struct
+{
+    char *directory;
+    meteoswiss_transport_t *inner;
+} RecorderState;
+
+typedef struct
+{
+    RecorderState *state;
+    void *inner; // Connection of the inner transport
+} RecorderConnection;
+
+// Copy of a body consumed by the sink of the request, forwarded to it
+typedef struct
+{
+    http_sink sink;
+    void *sink_userp;
+    HttpBuffer body;
+} RecorderTee;
+
+// Destination of the results of a recorded batch
+typedef struct
+{
+    RecorderConnection *connection;
+    const HttpRequest *requests;
+    http_batch_callback callback;
+    void *userp;
+} RecorderBatch;
+
+// Name of the recording of a URL, every character unsafe in a file name is
+// replaced. Fails rather than truncating, two URLs must not share a recording.
+static int record_key(const char *url, char *key)
+{
+    size_t i = 0;
+    for (; url[i] != '\0'; i++)
+    {
+        if (i == RECORD_KEY_SIZE - 1)
+        {
+            return -1;
+        }
+        unsigned char c = (unsigned char)url[i];
+        key[i] = (isalnum(c) || c == '-' || c == '.') ? (char)c : '_';
+    }
+    key[i] = '\0';
+    return 0;
+}
+
+static void sleep_us(long long us)
+{
+    struct timespec duration = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000L};
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
+}
+
+// Recorder
+
+// Write a response to the directory, through a temporary file so a replayer never sees a partial one
+static void record_write(RecorderConnection *connection, const char *url, const HttpResponse *response,
+                         const char *body, size_t length)
+{
+    char key[RECORD_KEY_SIZE];
+    char path[RECORD_PATH_SIZE];
+    char temporary[RECORD_PATH_SIZE];
+
+    if (record_key(url, key) != 0)
+    {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s" RECORD_EXTENSION, connection->state->directory, key);
+    snprintf(temporary, sizeof(temporary), "%s.%p.tmp", path, (void *)connection);
+
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    const HttpTimings *timings = &response->timings;
+    fprintf(file, "status: %ld\n", response->status_code);
+    fprintf(file, "etag: %s\n", response->etag);
+    fprintf(file, "last-modified: %s\n", response->last_modified);
+    fprintf(file, "dns-us: %lld\n", timings->dns_us);
+    fprintf(file, "connect-us: %lld\n", timings->connect_us);
+    fprintf(file, "tls-us: %lld\n", timings->tls_us);
+    fprintf(file, "wait-us: %lld\n", timings->wait_us);
+    fprintf(file, "transfer-us: %lld\n", timings->transfer_us);
+    fprintf(file, "total-us: %lld\n", timings->total_us);
+    fprintf(file, "bytes-received: %lld\n", timings->bytes_received);
+    fprintf(file, "\n");
+
+    int failed = (length > 0 && fwrite(body, 1, length, file) != length);
+    if (fclose(file) != 0 || failed || rename(temporary, path) != 0)
+    {
+        remove(temporary);
+    }
+}
+
+static void record_response(RecorderConnection *connection, const char *url, int status, const HttpResponse *response,
+                            const char *body, size_t length)
+{
+    // A 304 has no body to replay, the replayer answers conditional requests itself
+    if (status == METEOSWISS_SUCCESS && response && response->status_code != 304)
+    {
+        record_write(connection, url, response, body, length);
+    }
+}
+
+static int recorder_tee(void *userp, const char *data, size_t size)
+{
+    RecorderTee *tee = (RecorderTee *)userp;
+    if (http_buffer_append(&tee->body, data, size) != 0)
+    {
+        return -1;
+    }
+    return tee->sink(tee->sink_userp, data, size);
+}
+
+static void *recorder_open(void *state, const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    RecorderState *recorder = (RecorderState *)state;
+    RecorderConnection *connection = calloc(1, sizeof(RecorderConnection));
+    if (connection == NULL)
+    {
+        return NULL;
+    }
+
+    connection->state = recorder;
+    connection->inner = recorder->inner->ops->open(recorder->inner->state, config, share);
+    if (connection->inner == NULL)
+    {
+        free(connection);
+        return NULL;
+    }
+    return connection;
+}
+
+static void recorder_close(void *connection)
+{
+    RecorderConnection *recorder = (RecorderConnection *)connection;
+    recorder->state->inner->ops->close(recorder->inner);
+    free(recorder);
+}
+
+// Warm-up requests are not recorded, nothing replays them
+static int recorder_warm(void *connection, const char *url, unsigned int timeout_ms)
+{
+    RecorderConnection *recorder = (RecorderConnection *)connection;
+    const TransportOps *inner = recorder->state->inner->ops;
+    return inner->warm ? inner->warm(recorder->inner, url, timeout_ms) : METEOSWISS_SUCCESS;
+}
+
+static int recorder_get(void *connection, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    RecorderConnection *recorder = (RecorderConnection *)connection;
+    const TransportOps *inner = recorder->state->inner->ops;
+
+    if (request->sink == NULL)
+    {
+        int status = inner->get(recorder->inner, request, response, timeout_ms);
+        record_response(recorder, request->url, status, response, response->body.data, response->body.length);
+        return status;
+    }
+
+    // The body does not stay in the response, keep a copy on its way to the sink
+    HttpRequest teed = *request;
+    RecorderTee tee = {request->sink, request->sink_userp, {0}};
+    http_buffer_init(&tee.body, 0);
+    teed.sink = recorder_tee;
+    teed.sink_userp = &tee;
+
+    int status = inner->get(recorder->inner, &teed, response, timeout_ms);
+    record_response(recorder, request->url, status, response, tee.body.data, tee.body.length);
+    http_buffer_free(&tee.body);
+    return status;
+}
+
+static int recorder_get_hedged(void *connection, const HttpRequest *request, HttpResponse *response,
+                               unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    RecorderConnection *recorder = (RecorderConnection *)connection;
+    int status = recorder->state->inner->ops->get_hedged(recorder->inner, request, response,
+                                                         timeout_ms, hedge_delay_ms, hedged);
+    record_response(recorder, request->url, status, response, response->body.data, response->body.length);
+    return status;
+}
+
+static void recorder_batch_callback(void *userp, size_t index, int status, HttpResponse *response)
+{
+    RecorderBatch *batch = (RecorderBatch *)userp;
+    if (response)
+    {
+        record_response(batch->connection, batch->requests[index].url, status, response,
+                        response->body.data, response->body.length);
+    }
+    batch->callback(batch->userp, index, status, response);
+}
+
+static int recorder_get_batch(void *connection, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                              unsigned int timeout_ms, http_batch_callback callback, void *userp)
+{
+    RecorderConnection *recorder = (RecorderConnection *)connection;
+    RecorderBatch batch = {recorder, requests, callback, userp};
+    return recorder->state->inner->ops->get_batch(recorder->inner, requests, count, max_in_flight,
+                                                  timeout_ms, recorder_batch_callback, &batch);
+}
+
+static void recorder_destroy(void *state)
+{
+    RecorderState *recorder = (RecorderState *)state;
+    free(recorder->directory);
+    free(recorder);
+}
+
+static const TransportOps recorder_ops = {
+    recorder_open,
+    recorder_close,
+    recorder_warm,
+    recorder_get,
+    recorder_get_hedged,
+    recorder_get_batch,
+    recorder_destroy
+};
+
+meteoswiss_transport_t *meteoswiss_transport_recorder_create(const char *directory)
+{
+    if (directory == NULL)
+    {
+        return NULL;
+    }
+
+    meteoswiss_transport_t *transport = calloc(1, sizeof(meteoswiss_transport_t));
+    RecorderState *state = calloc(1, sizeof(RecorderState));
+    char *copy = malloc(strlen(directory) + 1);
+    if (transport == NULL || state == NULL || copy == NULL)
+    {
+        free(transport);
+        free(state);
+        free(copy);
+        return NULL;
+    }
+
+    strcpy(copy, directory);
+    state->directory = copy;
+    state->inner = transport_default();
+    transport->ops = &recorder_ops;
+    transport->state = state;
+    return transport;
+}
+
+// Replayer
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const ReplayEntry *)a)->key, ((const ReplayEntry *)b)->key);
+}
+
+// Read the header of a recording, the body follows the first empty line
+static int parse_recording(ReplayEntry *entry)
+{
+    const char *data = (const char *)entry->map;
+    const char *end = data + entry->map_size;
+    const char *line = data;
+
+    entry->status_code = 0;
+    while (line < end)
+    {
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        if (newline == NULL)
+        {
+            return -1;
+        }
+        if (newline == line)
+        {
+            entry->body = newline + 1;
+            entry->body_length = (size_t)(end - entry->body);
+            return entry->status_code ? 0 : -1;
+        }
+
+        char text[RECORD_LINE_SIZE];
+        size_t length = (size_t)(newline - line);
+        if (length >= sizeof(text))
+        {
+            return -1;
+        }
+        memcpy(text, line, length);
+        text[length] = '\0';
+
+        char *value = strstr(text, ": ");
+        if (value)
+        {
+            *value = '\0';
+            value += 2;
+
+            if (strcmp(text, "status") == 0)
+                entry->status_code = atol(value);
+            else if (strcmp(text, "etag") == 0)
+                snprintf(entry->etag, sizeof(entry->etag), "%s", value);
+            else if (strcmp(text, "last-modified") == 0)
+                snprintf(entry->last_modified, sizeof(entry->last_modified), "%s", value);
+            else if (strcmp(text, "dns-us") == 0)
+                entry->timings.dns_us = atoll(value);
+            else if (strcmp(text, "connect-us") == 0)
+                entry->timings.connect_us = atoll(value);
+            else if (strcmp(text, "tls-us") == 0)
+                entry->timings.tls_us = atoll(value);
+            else if (strcmp(text, "wait-us") == 0)
+                entry->timings.wait_us = atoll(value);
+            else if (strcmp(text, "transfer-us") == 0)
+                entry->timings.transfer_us = atoll(value);
+            else if (strcmp(text, "total-us") == 0)
+                entry->timings.total_us = atoll(value);
+            else if (strcmp(text, "bytes-received") == 0)
+                entry->timings.bytes_received = atoll(value);
+        }
+        line = newline + 1;
+    }
+    return -1;
+}
+
+// Map a recording, 0 if it was added to the state
+static int load_recording(ReplayerState *state, size_t *capacity, const char *directory, const char *name)
+{
+    size_t name_length = strlen(name);
+    size_t extension_length = sizeof(RECORD_EXTENSION) - 1;
+    if (name_length <= extension_length || name_length - extension_length >= RECORD_KEY_SIZE ||
+        strcmp(name + name_length - extension_length, RECORD_EXTENSION) != 0)
+    {
+        return -1;
+    }
+
+    char path[RECORD_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat info;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    if (state->count == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        ReplayEntry *entries = realloc(state->entries, new_capacity * sizeof(ReplayEntry));
+        if (entries == NULL)
+        {
+            munmap(map, (size_t)info.st_size);
+            return -1;
+        }
+        state->entries = entries;
+        *capacity = new_capacity;
+    }
+
+    ReplayEntry *entry = &state->entries[state->count];
+    memset(entry, 0, sizeof(ReplayEntry));
+    memcpy(entry->key, name, name_length - extension_length);
+    entry->key[name_length - extension_length] = '\0';
+    entry->map = map;
+    entry->map_size = (size_t)info.st_size;
+    if (parse_recording(entry) != 0)
+    {
+        munmap(map, entry->map_size);
+        return -1;
+    }
+
+    state->count++;
+    return 0;
+}
+
+static const ReplayEntry *replay_lookup(const ReplayerState *state, const char *url)
+{
+    ReplayEntry key;
+    if (record_key(url, key.key) != 0)
+    {
+        return NULL;
+    }
+    return bsearch(&key, state->entries, state->count, sizeof(ReplayEntry), compare_entries);
+}
+
+static void *replayer_open(void *state, const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    (void)share;
+    ReplayerConnection *connection = calloc(1, sizeof(ReplayerConnection));
+    if (connection == NULL)
+    {
+        return NULL;
+    }
+    connection->state = (ReplayerState *)state;
+    http_response_init(&connection->response, config->max_response_size);
+    return connection;
+}
+
+static void replayer_close(void *connection)
+{
+    ReplayerConnection *replayer = (ReplayerConnection *)connection;
+    http_response_free(&replayer->response);
+    free(replayer);
+}
+
+static int replayer_get(void *connection, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    ReplayerConnection *replayer = (ReplayerConnection *)connection;
+
+    http_response_start(response, request);
+
+    const ReplayEntry *entry = replay_lookup(replayer->state, request->url);
+    if (entry == NULL)
+    {
+        return METEOSWISS_ERROR;
+    }
+
+    if (replayer->state->simulate_latency)
+    {
+        long long timeout_us = (long long)timeout_ms * 1000LL;
+        if (timeout_ms && entry->timings.total_us > timeout_us)
+        {
+            sleep_us(timeout_us);
+            return METEOSWISS_ERROR;
+        }
+        sleep_us(entry->timings.total_us);
+    }
+
+    memcpy(response->etag, entry->etag, sizeof(response->etag));
+    memcpy(response->last_modified, entry->last_modified, sizeof(response->last_modified));
+    response->timings = entry->timings;
+
+    if ((request->if_none_match && entry->etag[0] && strcmp(request->if_none_match, entry->etag) == 0) ||
+        (request->if_modified_since && entry->last_modified[0] &&
+         strcmp(request->if_modified_since, entry->last_modified) == 0))
+    {
+        response->status_code = 304;
+        return METEOSWISS_SUCCESS;
+    }
+
+    response->status_code = entry->status_code;
+
+    // Like the live backend, a streamed body is only counted, never stored
+    if (request->sink)
+    {
+        if (response->body.max_size && entry->body_length > response->body.max_size)
+        {
+            response->body.overflow = 1;
+            return METEOSWISS_ERROR_RESPONSE_TOO_LARGE;
+        }
+        if (request->sink(request->sink_userp, entry->body, entry->body_length) != 0)
+        {
+            return METEOSWISS_ERROR;
+        }
+        response->body.length = entry->body_length;
+        return METEOSWISS_SUCCESS;
+    }
+
+    if (http_buffer_append(&response->body, entry->body, entry->body_length) != 0)
+    {
+        return response->body.overflow ? METEOSWISS_ERROR_RESPONSE_TOO_LARGE : METEOSWISS_ERROR;
+    }
+    return METEOSWISS_SUCCESS;
+}
+
+static int replayer_get_hedged(void *connection, const HttpRequest *request, HttpResponse *response,
+                               unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    // Replayed responses do not stall, there is nothing to hedge
+    (void)hedge_delay_ms;
+    if (hedged)
+    {
+        *hedged = 0;
+    }
+    return replayer_get(connection, request, response, timeout_ms);
+}
+
+static int replayer_get_batch(void *connection, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                              unsigned int timeout_ms, http_batch_callback callback, void *userp)
+{
+    ReplayerConnection *replayer = (ReplayerConnection *)connection;
+    int status = METEOSWISS_SUCCESS;
+
+    (void)max_in_flight;
+    for (size_t i = 0; i < count; i++)
+    {
+        int result = replayer_get(connection, &requests[i], &replayer->response, timeout_ms);
+        if (result != METEOSWISS_SUCCESS)
+        {
+            status = METEOSWISS_ERROR;
+        }
+        callback(userp, i, result, &replayer->response);
+    }
+    return status;
+}
+
+static void replayer_destroy(void *state)
+{
+    ReplayerState *replayer = (ReplayerState *)state;
+    for (size_t i = 0; i < replayer->count; i++)
+    {
+        munmap(replayer->entries[i].map, replayer->entries[i].map_size);
+    }
+    free(replayer->entries);
+    free(replayer);
+}
+
+static const TransportOps replayer_ops = {
+    replayer_open,
+    replayer_close,
+    NULL,
+    replayer_get,
+    replayer_get_hedged,
+    replayer_get_batch,
+    replayer_destroy
+};
+
+meteoswiss_transport_t *meteoswiss_transport_replayer_create(const char *directory, int simulate_latency)
+{
+    if (directory == NULL)
+    {
+        return NULL;
+    }
+
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+
+    meteoswiss_transport_t *transport = calloc(1, sizeof(meteoswiss_transport_t));
+    ReplayerState *state = calloc(1, sizeof(ReplayerState));
+    if (transport == NULL || state == NULL)
+    {
+        free(transport);
+        free(state);
+        closedir(dir);
+        return NULL;
+    }
+    state->simulate_latency = simulate_latency;
+
+    // Every recording is mapped upfront, requests are then served without any I/O
+    size_t capacity = 0;
+    struct dirent *file;
+    while ((file = readdir(dir)) != NULL)
+    {
+        load_recording(state, &capacity, directory, file->d_name);
+    }
+    closedir(dir);
+
+    qsort(state->entries, state->count, sizeof(ReplayEntry), compare_entries);
+    transport->ops = &replayer_ops;
+    transport->state = state;
+    return transport;
+}
+
+#else
+
+meteoswiss_transport_t *meteoswiss_transport_recorder_create(const char *directory)
+{
+    // No file system support on this platform
+    (void)directory;
+    return NULL;
+}
+
+meteoswiss_transport_t *meteoswiss_transport_replayer_create(const char *directory, int simulate_latency)
+{
+    (void)directory;
+    (void)simulate_latency;
+    return NULL;
+}
+
+#endif // HTTP_WRAPPER_DESKTOP
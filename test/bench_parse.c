@@ -0,0 +1,376 @@
+/*
+ * GNU LESSER GENERAL PUBLIC LICENSE
+ * Version 3, 29 June 2007
+ * Copyright (C) 2024 Mathieu Bourquenoud
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Compares the single-pass parser with the json.h DOM parser, and the number
+// decoder with atof(), on a synthetic plzDetail response or on the saved
+// responses given as arguments.
+
+#include "meteoswiss.h"
+#include "meteoswiss_internal.h"
+#include "json_number.h"
+#include "json_stream.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MIN_TIME_MS 500
+#define FORECAST_DAYS 10
+#define NUMBER_BUFFER_SIZE 64
+
+typedef int (*parse_function)(const char *response, size_t length, MeteoSwissData *data,
+                              MeteoSwissQueryStats *stats);
+
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} Document;
+
+static void append(Document *doc, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (doc->length + length + 1 > doc->capacity)
+    {
+        doc->capacity = (doc->length + length + 1) * 2;
+        doc->data = realloc(doc->data, doc->capacity);
+        if (doc->data == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    va_start(args, format);
+    vsnprintf(doc->data + doc->length, doc->capacity - doc->length, format, args);
+    va_end(args);
+    doc->length += length;
+}
+
+// Deterministic pseudo-random values, so that every run parses the same document
+static unsigned int random_state = 12345;
+
+static double random_between(double low, double high)
+{
+    random_state = random_state * 1103515245u + 12345u;
+    return low + (high - low) * ((random_state >> 8) & 0xffff) / 65535.0;
+}
+
+static void append_series(Document *doc, const char *key, int count, double low, double high, int decimals)
+{
+    append(doc, ",\"%s\":[", key);
+    for (int i = 0; i < count; i++)
+    {
+        append(doc, "%s%.*f", i ? "," : "", decimals, random_between(low, high));
+    }
+    append(doc, "]");
+}
+
+// A response shaped like the ones of the service, with series of the usual lengths
+static void generate_document(Document *doc)
+{
+    const long long start = 1729029600000LL;
+
+    append(doc, "{\"currentWeather\":{\"time\":%lld,\"icon\":%d,\"iconV2\":%d,\"temperature\":%.1f},\"forecast\":[",
+           start, 5, 105, 12.3);
+    for (int day = 0; day < FORECAST_DAYS; day++)
+    {
+        double low = random_between(-5, 12);
+        append(doc,
+               "%s{\"dayDate\":\"2024-10-%02d\",\"iconDay\":%d,\"iconDayV2\":%d,\"temperatureMax\":%.1f,"
+               "\"temperatureMin\":%.1f,\"precipitation\":%.1f,\"precipitationMin\":0.0,\"precipitationMax\":%.1f}",
+               day ? "," : "", 16 + day, 1 + day, 101 + day, low + random_between(1, 10), low,
+               random_between(0, 20), random_between(0, 30));
+    }
+    append(doc, "],\"warnings\":[],\"warningsOverview\":[],\"graph\":{\"start\":%lld,\"startLowResolution\":%lld",
+           start, start + 2 * 86400000LL);
+
+    append_series(doc, "precipitation10m", 288, 0, 3, 1);
+    append_series(doc, "precipitationMin10m", 288, 0, 1, 1);
+    append_series(doc, "precipitationMax10m", 288, 0, 5, 1);
+    append_series(doc, "weatherIcon3h", 64, 1, 40, 0);
+    append_series(doc, "weatherIcon3hV2", 64, 101, 140, 0);
+    append_series(doc, "windDirection3h", 64, 0, 359, 0);
+    append_series(doc, "windSpeed3h", 64, 0, 40, 1);
+    append_series(doc, "sunrise", FORECAST_DAYS, start, start + 9 * 86400000.0, 0);
+    append_series(doc, "sunset", FORECAST_DAYS, start, start + 9 * 86400000.0, 0);
+    append_series(doc, "temperatureMin1h", 192, -5, 15, 1);
+    append_series(doc, "temperatureMax1h", 192, 0, 25, 1);
+    append_series(doc, "temperatureMean1h", 192, -2, 20, 1);
+    append_series(doc, "precipitation1h", 192, 0, 4, 1);
+    append_series(doc, "precipitationMin1h", 192, 0, 2, 1);
+    append_series(doc, "precipitationMax1h", 192, 0, 6, 1);
+    append_series(doc, "windSpeed1h", 192, 0, 30, 1);
+    append_series(doc, "windSpeed1hq10", 192, 0, 20, 1);
+    append_series(doc, "windSpeed1hq90", 192, 0, 40, 1);
+    append_series(doc, "gustSpeed1h", 192, 0, 60, 1);
+    append_series(doc, "gustSpeed1hq10", 192, 0, 40, 1);
+    append_series(doc, "gustSpeed1hq90", 192, 0, 80, 1);
+    append_series(doc, "sunshine1h", 192, 0, 60, 0);
+    append_series(doc, "precipitationProbability3h", 64, 0, 100, 0);
+    append(doc, "}}");
+}
+
+static int load_document(Document *doc, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        append(doc, "%.*s", (int)read, chunk);
+    }
+    fclose(file);
+    return 0;
+}
+
+static long long monotonic_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Parse the document repeatedly for at least BENCH_MIN_TIME_MS, return the time per parse in microseconds
+static double bench(parse_function parse, const Document *doc)
+{
+    long long iterations = 0;
+    long long start_us = monotonic_us();
+    long long elapsed_us;
+    do
+    {
+        MeteoSwissData data;
+        if (parse(doc->data, doc->length, &data, NULL) != 0)
+        {
+            return -1;
+        }
+        meteoswiss_data_free(&data);
+        iterations++;
+        elapsed_us = monotonic_us() - start_us;
+    } while (elapsed_us < BENCH_MIN_TIME_MS * 1000LL);
+
+    return (double)elapsed_us / iterations;
+}
+
+// Numbers of a document, as offsets into it
+typedef struct
+{
+    const Document *doc;
+    size_t *offsets;
+    size_t *lengths;
+    size_t count;
+    size_t capacity;
+} NumberList;
+
+static int collect_number(void *userp, JsonStreamEvent event, const char *text, size_t length)
+{
+    NumberList *list = (NumberList *)userp;
+    if (event != JSON_STREAM_NUMBER)
+    {
+        return 0;
+    }
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->offsets = realloc(list->offsets, list->capacity * sizeof(size_t));
+        list->lengths = realloc(list->lengths, list->capacity * sizeof(size_t));
+        if (list->offsets == NULL || list->lengths == NULL)
+        {
+            return -1;
+        }
+    }
+    // Fed in one chunk, the tokens point into the document
+    list->offsets[list->count] = (size_t)(text - list->doc->data);
+    list->lengths[list->count] = length;
+    list->count++;
+    return 0;
+}
+
+// Conversion of the parsers before the number decoder, through a null-terminated copy
+static double copy_atof(const char *text, size_t length)
+{
+    char buffer[NUMBER_BUFFER_SIZE];
+    if (length > NUMBER_BUFFER_SIZE - 1)
+    {
+        length = NUMBER_BUFFER_SIZE - 1;
+    }
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return atof(buffer);
+}
+
+// Convert all the numbers repeatedly for at least BENCH_MIN_TIME_MS, return the time per number in nanoseconds
+static double bench_numbers(double (*convert)(const char *, size_t), const NumberList *list)
+{
+    volatile double sink = 0;
+    long long iterations = 0;
+    long long start_us = monotonic_us();
+    long long elapsed_us;
+    do
+    {
+        for (size_t i = 0; i < list->count; i++)
+        {
+            sink += convert(list->doc->data + list->offsets[i], list->lengths[i]);
+        }
+        iterations++;
+        elapsed_us = monotonic_us() - start_us;
+    } while (elapsed_us < BENCH_MIN_TIME_MS * 1000LL);
+
+    (void)sink;
+    return elapsed_us * 1000.0 / ((double)iterations * list->count);
+}
+
+static int run_numbers(const char *name, const Document *doc)
+{
+    NumberList list = {doc, NULL, NULL, 0, 0};
+    JsonStream stream;
+    json_stream_init(&stream, collect_number, &list);
+    int result = json_stream_feed(&stream, doc->data, doc->length) == 0 ? json_stream_finish(&stream) : -1;
+    json_stream_free(&stream);
+    if (result != 0 || list.count == 0)
+    {
+        printf("%s: no numbers found\n", name);
+        free(list.offsets);
+        free(list.lengths);
+        return 1;
+    }
+
+    // The decoder must give the same doubles as atof()
+    for (size_t i = 0; i < list.count; i++)
+    {
+        const char *text = doc->data + list.offsets[i];
+        double expected = copy_atof(text, list.lengths[i]);
+        double decoded = json_number_to_double(text, list.lengths[i]);
+        if (memcmp(&expected, &decoded, sizeof(double)) != 0)
+        {
+            printf("%s: %.*s decoded as %.17g instead of %.17g\n", name, (int)list.lengths[i], text, decoded,
+                   expected);
+            result = 1;
+        }
+    }
+
+    if (result == 0)
+    {
+        double atof_ns = bench_numbers(copy_atof, &list);
+        double decoder_ns = bench_numbers(json_number_to_double, &list);
+        printf("  %zu numbers\n", list.count);
+        printf("  atof         %8.1f ns per number\n", atof_ns);
+        printf("  decoder      %8.1f ns per number  x%.2f\n", decoder_ns, atof_ns / decoder_ns);
+    }
+    free(list.offsets);
+    free(list.lengths);
+    return result;
+}
+
+static int same_data(const MeteoSwissData *a, const MeteoSwissData *b)
+{
+    if (memcmp(&a->currentWeather, &b->currentWeather, sizeof(CurrentWeather)) != 0 ||
+        a->forecast_count != b->forecast_count || a->graph.start != b->graph.start ||
+        a->graph.startLowResolution != b->graph.startLowResolution ||
+        a->graph.precipitation10m_count != b->graph.precipitation10m_count)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < a->forecast_count; i++)
+    {
+        if (memcmp(&a->forecast[i], &b->forecast[i], sizeof(ForecastEntry)) != 0)
+        {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < a->graph.precipitation10m_count; i++)
+    {
+        if (a->graph.precipitation10m[i] != b->graph.precipitation10m[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int run(const char *name, const Document *doc)
+{
+    // Both parsers must agree before their speed means anything
+    MeteoSwissData single_pass, dom;
+    if (meteoswiss_parse_response(doc->data, doc->length, &single_pass, NULL) != 0)
+    {
+        printf("%s: rejected by the single-pass parser\n", name);
+        return 1;
+    }
+    if (meteoswiss_parse_response_dom(doc->data, doc->length, &dom, NULL) != 0)
+    {
+        printf("%s: rejected by the DOM parser\n", name);
+        meteoswiss_data_free(&single_pass);
+        return 1;
+    }
+    int same = same_data(&single_pass, &dom);
+    meteoswiss_data_free(&single_pass);
+    meteoswiss_data_free(&dom);
+    if (!same)
+    {
+        printf("%s: the parsers extracted different data\n", name);
+        return 1;
+    }
+
+    double single_pass_us = bench(meteoswiss_parse_response, doc);
+    double dom_us = bench(meteoswiss_parse_response_dom, doc);
+    printf("%s (%zu bytes)\n", name, doc->length);
+    printf("  json.h DOM   %8.1f us  %7.1f MB/s\n", dom_us, doc->length / dom_us);
+    printf("  single pass  %8.1f us  %7.1f MB/s  x%.2f\n", single_pass_us, doc->length / single_pass_us,
+           dom_us / single_pass_us);
+    return run_numbers(name, doc);
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    if (argc < 2)
+    {
+        Document doc = {0};
+        generate_document(&doc);
+        failures += run("synthetic plzDetail", &doc);
+        free(doc.data);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        Document doc = {0};
+        if (load_document(&doc, argv[i]) != 0)
+        {
+            printf("%s: cannot be read\n", argv[i]);
+            failures++;
+            continue;
+        }
+        failures += run(argv[i], &doc);
+        free(doc.data);
+    }
+    return failures ? 1 : 0;
+}
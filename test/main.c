@@ -19,8 +19,25 @@
  */
 
 #include "meteoswiss.h"
+#include "meteoswiss_internal.h"
+#include "json_number.h"
+#include "plzdetail_stream.h"
+#include "transport.h"
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ASYNC_MAX_SOCKETS 16
+#define RECORDINGS_DIR "test/recordings"
+#define TLS_SESSIONS_FILE "test_tls_sessions.bin"
 
 // Function to validate data fields
 int validate_data(const MeteoSwissData *data, int expect_failure)
@@ -74,17 +91,21 @@ int validate_data(const MeteoSwissData *data, int expect_failure)
     return valid;
 }
 
-// Run a test for a single postal code
-int run_test(int postal_code, int expect_failure, unsigned int timeout)
+// Run a test for a single postal code, through the client if one is given
+int run_test(meteoswiss_client_t *client, int postal_code, int expect_failure, unsigned int timeout)
 {
     int valid = 1;
-    printf("Testing postal code: %04d\n", postal_code);
+    printf("Testing postal code: %04d%s\n", postal_code, (client ? " (client)" : ""));
     printf("Expecting a %s\n", (expect_failure ? "failure" : "success"));
 
     MeteoSwissData data;
     memset(&data, 0, sizeof(MeteoSwissData));
 
-    int result = meteoswiss_query(postal_code, &data, timeout); // No timeout
+    int result;
+    if (client)
+        result = meteoswiss_client_query(client, postal_code, &data, timeout);
+    else
+        result = meteoswiss_query(postal_code, &data, timeout);
     if (result != 0 && !expect_failure)
     {
         printf("Unexpected query failure for postal code %d.\n", postal_code);
@@ -113,6 +134,1067 @@ int run_test(int postal_code, int expect_failure, unsigned int timeout)
     return valid;
 }
 
+// Run a batch query and check each result against its expected outcome
+int run_batch_test(meteoswiss_client_t *client, const int *postal_codes, const int *expect_failure, size_t count)
+{
+    int valid = 1;
+    MeteoSwissData data[8];
+    int status[8];
+
+    printf("Testing a batch of %zu postal codes\n", count);
+    meteoswiss_client_query_batch(client, postal_codes, count, data, status, 0, 0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((status[i] != 0) != expect_failure[i])
+        {
+            printf("Unexpected batch %s for postal code %d.\n", (status[i] ? "failure" : "success"), postal_codes[i]);
+            valid = 0;
+        }
+        else if (!expect_failure[i] && !validate_data(&data[i], 0))
+        {
+            printf("Unexpected validation failure for postal code %d.\n", postal_codes[i]);
+            valid = 0;
+        }
+        meteoswiss_data_free(&data[i]);
+    }
+
+    return valid;
+}
+
+// Decode numbers at the edges of the fast path, which must match strtod() bit for bit
+int run_json_number_test(void)
+{
+    int valid = 1;
+    printf("Testing the JSON number decoder\n");
+
+    static const char *const doubles[] = {
+        // Largest integers exact in a double, then the first ones that round
+        "9007199254740991", "9007199254740992", "9007199254740993", "9007199254740995", "-9007199254740993",
+        // Largest and smallest exact powers of ten, then the first inexact ones
+        "1e22", "1e23", "1e-22", "1e-23", "4.5e22", "9007199254740991e22", "9007199254740993e-22",
+        // More than 19 significant digits, including a halfway case and its neighbour
+        "12345678901234567890", "12345678901234567890123", "0.12345678901234567890123", "18446744073709551615",
+        "18446744073709551616", "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203126",
+        // Leading zeros in the fraction
+        "0.0001", "0.000000000000000000000000123", "0.00000000000000000001234567890123456789", "00.5",
+        // Negative zero
+        "-0", "-0.0", "-0e5", "-0.000e-5",
+        // Huge exponents
+        "1e308", "1.7976931348623157e308", "1e309", "1e400", "-1e400", "1e-320", "1e-400",
+        "1e99999999999999999999", "1e-99999999999999999999", "0e99999999999999999999", "123E+2", "5e-0"};
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++)
+    {
+        double expected = strtod(doubles[i], NULL);
+        double decoded = json_number_to_double(doubles[i], strlen(doubles[i]));
+        if (memcmp(&expected, &decoded, sizeof(double)) != 0)
+        {
+            printf("Decoded %s as %.17g instead of %.17g.\n", doubles[i], decoded, expected);
+            valid = 0;
+        }
+    }
+    if (!signbit(json_number_to_double("-0", 2)))
+    {
+        printf("Decoded -0 without its sign.\n");
+        valid = 0;
+    }
+
+    // The number is read in place, the characters after it do not count
+    if (json_number_to_double("1.5e3,", 5) != 1500.0 || json_number_to_double("25]", 2) != 25.0)
+    {
+        printf("Decoded characters past the end of a number.\n");
+        valid = 0;
+    }
+
+    static const struct
+    {
+        const char *text;
+        long long expected;
+    } integers[] = {{"0", 0},
+                    {"-0", 0},
+                    {"12.9", 12},
+                    {"-7e3", -7},
+                    {"9223372036854775807", LLONG_MAX},
+                    {"9223372036854775808", LLONG_MAX},
+                    {"99999999999999999999999", LLONG_MAX},
+                    {"-9223372036854775807", -LLONG_MAX},
+                    {"-9223372036854775808", LLONG_MIN},
+                    {"-9223372036854775809", LLONG_MIN},
+                    {"-99999999999999999999999", LLONG_MIN}};
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++)
+    {
+        long long decoded = json_number_to_long_long(integers[i].text, strlen(integers[i].text));
+        if (decoded != integers[i].expected)
+        {
+            printf("Decoded %s as %lld instead of %lld.\n", integers[i].text, decoded, integers[i].expected);
+            valid = 0;
+        }
+    }
+
+    if (json_number_to_int("2147483647", 10) != INT_MAX || json_number_to_int("2147483648", 10) != INT_MAX ||
+        json_number_to_int("-2147483648", 11) != INT_MIN || json_number_to_int("-2147483649", 11) != INT_MIN)
+    {
+        printf("Decoded an int out of range without saturating it.\n");
+        valid = 0;
+    }
+
+    return valid;
+}
+
+static int same_data(const MeteoSwissData *a, const MeteoSwissData *b)
+{
+    if (memcmp(&a->currentWeather, &b->currentWeather, sizeof(CurrentWeather)) != 0 ||
+        a->forecast_count != b->forecast_count || a->graph.start != b->graph.start ||
+        a->graph.startLowResolution != b->graph.startLowResolution ||
+        a->graph.precipitation10m_count != b->graph.precipitation10m_count)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < a->forecast_count; i++)
+    {
+        if (memcmp(&a->forecast[i], &b->forecast[i], sizeof(ForecastEntry)) != 0)
+        {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < a->graph.precipitation10m_count; i++)
+    {
+        if (a->graph.precipitation10m[i] != b->graph.precipitation10m[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Parse a document with the single-pass parser, the DOM parser and the
+// streaming parser fed in two chunks split at every offset, which must all agree
+static int parsers_agree(const char *name, const char *doc, size_t length, int expect_failure)
+{
+    MeteoSwissData single_pass, dom;
+    memset(&single_pass, 0, sizeof(MeteoSwissData));
+    memset(&dom, 0, sizeof(MeteoSwissData));
+    int single_pass_status = meteoswiss_parse_response(doc, length, &single_pass, NULL);
+    int dom_status = meteoswiss_parse_response_dom(doc, length, &dom, NULL);
+
+    int valid = 1;
+    if ((single_pass_status != 0) != (dom_status != 0))
+    {
+        printf("%s: %s by the single-pass parser only.\n", name, single_pass_status ? "rejected" : "accepted");
+        valid = 0;
+    }
+    else if ((single_pass_status != 0) != expect_failure)
+    {
+        printf("%s: unexpectedly %s.\n", name, single_pass_status ? "rejected" : "accepted");
+        valid = 0;
+    }
+    else if (single_pass_status == 0 && !same_data(&single_pass, &dom))
+    {
+        printf("%s: the parsers extracted different data.\n", name);
+        valid = 0;
+    }
+
+    PlzDetailStream stream;
+    plzdetail_stream_init(&stream);
+    for (size_t split = 0; split <= length && valid; split++)
+    {
+        MeteoSwissData streamed;
+        memset(&streamed, 0, sizeof(MeteoSwissData));
+        plzdetail_stream_reset(&stream);
+        int status = plzdetail_stream_feed(&stream, doc, split);
+        if (status == 0)
+        {
+            status = plzdetail_stream_feed(&stream, doc + split, length - split);
+        }
+        status = (status == 0) ? plzdetail_stream_finish(&stream, &streamed) : -1;
+
+        if ((status != 0) != (single_pass_status != 0) || (status == 0 && !same_data(&streamed, &single_pass)))
+        {
+            printf("%s: the streaming parser disagrees when split at %zu.\n", name, split);
+            valid = 0;
+        }
+        meteoswiss_data_free(&streamed);
+    }
+    plzdetail_stream_free(&stream);
+
+    meteoswiss_data_free(&single_pass);
+    meteoswiss_data_free(&dom);
+    return valid;
+}
+
+// A variant of a document, with the text from the first occurrence of from
+// to the end of the next occurrence of until (or of from if NULL) replaced
+typedef struct
+{
+    const char *name;
+    const char *from;
+    const char *until;
+    const char *to;
+    int expect_failure;
+} DocumentEdit;
+
+// Check the parsers against each other on variants of a recorded response
+int run_parser_equivalence_test(void)
+{
+    int valid = 1;
+    printf("Testing the single-pass parser against the DOM parser\n");
+
+    static char base[4096];
+    FILE *file = fopen(RECORDINGS_DIR "/https___app-prod-ws.meteoswiss-app.ch_v1_plzDetail_plz_120100.http", "rb");
+    size_t size = file ? fread(base, 1, sizeof(base) - 1, file) : 0;
+    if (file)
+    {
+        fclose(file);
+    }
+    base[size] = '\0';
+    const char *body = strstr(base, "\n\n");
+    if (body == NULL)
+    {
+        printf("Failed to load the recording of 1201.\n");
+        return 0;
+    }
+    body += 2;
+
+    static const DocumentEdit edits[] = {
+        {"unchanged", "", NULL, "", 0},
+        {"missing currentWeather key", "\"iconV2\":105,", NULL, "", 1},
+        {"missing forecast entry key", "\"precipitationMin\":2.1,", NULL, "", 1},
+        {"missing graph key", "\"sunshine1h\":[0,0,0],", NULL, "", 1},
+        {"missing section", "\"warnings\":[],", NULL, "", 1},
+        {"string temperature", "\"temperature\":12.3", NULL, "\"temperature\":\"12.3\"", 0},
+        {"boolean icon", "\"iconDay\":2,", NULL, "\"iconDay\":true,", 0},
+        {"null time", "\"time\":1729029600000", NULL, "\"time\":null", 0},
+        {"non-number precipitations", "[0.0,0.0,0.1,0.3,0.2,0.0]", NULL, "[0.0,\"x\",null,[1],{},true]", 0},
+        {"object instead of array", "\"precipitation10m\":[", "]", "\"precipitation10m\":{\"a\":0.0}", 1},
+        {"null graph array", "\"sunset\":[", "]", "\"sunset\":null", 1},
+        {"scalar section", "\"warnings\":[]", NULL, "\"warnings\":0", 1},
+        {"array instead of object", "\"currentWeather\":{", "}", "\"currentWeather\":[]", 1},
+        {"string entry", "{\"dayDate\":\"2024-10-18\"", "}", "\"2024-10-18\"", 1},
+        {"empty forecast", "\"forecast\":[", "],\"warnings\"", "\"forecast\":[],\"warnings\"", 0},
+        {"empty precipitations", "\"precipitation10m\":[", "]", "\"precipitation10m\":[]", 0},
+        {"empty graph array", "\"weatherIcon3h\":[5,5,14]", NULL, "\"weatherIcon3h\":[]", 0},
+        {"duplicate temperature", "\"temperature\":12.3", NULL, "\"temperature\":12.3,\"temperature\":99.9", 0},
+        {"duplicate graph start", "\"graph\":{", NULL, "\"graph\":{\"start\":1,", 0},
+        {"duplicate section", "[20,40,60]}}", NULL, "[20,40,60]},\"forecast\":[]}", 0},
+        {"unknown root key", "\"currentWeather\":{", NULL,
+         "\"extra\":{\"nested\":[1,{\"forecast\":[]},\"}\"]},\"currentWeather\":{", 0},
+        {"unknown entry key", "\"iconDay\":14,", NULL, "\"iconDay\":14,\"unknown\":[[],{\"a\":\"]\"}],", 0},
+        {"escaped key", "\"dayDate\":\"2024-10-18\"", NULL, "\"day\\u0044ate\":\"2024-10-18\"", 0},
+        {"escaped date", "\"2024-10-18\"", NULL, "\"2024\\u002d10\\/18\"", 0},
+        {"trailing content", "[20,40,60]}}", NULL, "[20,40,60]}}{}", 1},
+        {"trailing whitespace", "[20,40,60]}}", NULL, "[20,40,60]}} \r\n\t", 0}};
+
+    char doc[sizeof(base) + 256];
+    for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); i++)
+    {
+        const DocumentEdit *edit = &edits[i];
+        const char *start = strstr(body, edit->from);
+        const char *end = (start && edit->until) ? strstr(start, edit->until) : start;
+        if (end == NULL)
+        {
+            printf("%s: the recording does not contain %s.\n", edit->name, edit->from);
+            valid = 0;
+            continue;
+        }
+        end += strlen(edit->until ? edit->until : edit->from);
+        int length = snprintf(doc, sizeof(doc), "%.*s%s%s", (int)(start - body), body, edit->to, end);
+        valid &= parsers_agree(edit->name, doc, (size_t)length, edit->expect_failure);
+    }
+
+    // Every truncation of the response must be rejected
+    size_t body_length = strlen(body);
+    while (body_length > 0 && strchr(" \r\n\t", body[body_length - 1]))
+    {
+        body_length--;
+    }
+    for (size_t length = 0; length < body_length && valid; length++)
+    {
+        valid &= parsers_agree("truncated", body, length, 1);
+    }
+
+    return valid;
+}
+
+// Replay the checked-in recordings through a client, without the network
+int run_replay_test(int streaming_parse)
+{
+    printf("Testing replayed responses%s\n", (streaming_parse ? " (streaming)" : ""));
+
+    meteoswiss_transport_t *transport = meteoswiss_transport_replayer_create(RECORDINGS_DIR, 0);
+    if (transport == NULL)
+    {
+        printf("Failed to load the recordings of %s.\n", RECORDINGS_DIR);
+        return 0;
+    }
+
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    config.transport = transport;
+    config.streaming_parse = streaming_parse;
+    config.conditional_get = 1;
+    meteoswiss_client_t *client = meteoswiss_client_create(&config);
+    if (client == NULL)
+    {
+        printf("Failed to create the client.\n");
+        meteoswiss_transport_destroy(transport);
+        return 0;
+    }
+
+    // The recording has an ETag, asking again must get a 304 and the result of the first query
+    int valid = 1;
+    MeteoSwissData first, second;
+    MeteoSwissQueryStats stats;
+    memset(&first, 0, sizeof(MeteoSwissData));
+    memset(&second, 0, sizeof(MeteoSwissData));
+    if (meteoswiss_client_query_ex(client, 1201, &first, 0, &stats) != 0 || stats.http_status != 200 ||
+        meteoswiss_client_query_ex(client, 1201, &second, 0, &stats) != 0)
+    {
+        printf("Unexpected failure of the repeated query for 1201.\n");
+        valid = 0;
+    }
+    else if (stats.http_status != 304 || !stats.not_modified)
+    {
+        printf("The repeated query for 1201 got a %ld instead of a 304.\n", stats.http_status);
+        valid = 0;
+    }
+    else if (!same_data(&first, &second) || second.forecast == first.forecast)
+    {
+        printf("The repeated query for 1201 did not get a copy of the cached result.\n");
+        valid = 0;
+    }
+    meteoswiss_data_free(&first);
+    meteoswiss_data_free(&second);
+
+    // 1201 is recorded, 8001 is not
+    valid &= run_test(client, 1201, 0, 0);
+    valid &= run_test(client, 8001, 1, 0);
+
+    meteoswiss_client_destroy(client);
+    meteoswiss_transport_destroy(transport);
+    return valid;
+}
+
+// Query the same postal code into one result, which must settle on the same arrays
+int run_query_into_test(void)
+{
+    int valid = 1;
+    printf("Testing queries into the arrays of a previous result\n");
+
+    meteoswiss_transport_t *transport = meteoswiss_transport_replayer_create(RECORDINGS_DIR, 0);
+    if (transport == NULL)
+    {
+        printf("Failed to load the recordings of %s.\n", RECORDINGS_DIR);
+        return 0;
+    }
+
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    config.transport = transport;
+    config.streaming_parse = 1;
+    meteoswiss_client_t *client = meteoswiss_client_create(&config);
+    if (client == NULL)
+    {
+        printf("Failed to create the client.\n");
+        meteoswiss_transport_destroy(transport);
+        return 0;
+    }
+
+    MeteoSwissData data;
+    memset(&data, 0, sizeof(MeteoSwissData));
+
+    // The parser and the result swap their arrays, which stop growing once both were sized
+    const ForecastEntry *forecast[5];
+    const float *precipitation[5];
+    for (int i = 0; i < 5 && valid; i++)
+    {
+        if (meteoswiss_client_query_into(client, 1201, METEOSWISS_PRIORITY_INTERACTIVE, &data, 0, NULL) != 0 ||
+            !validate_data(&data, 0))
+        {
+            printf("Unexpected failure of query %d.\n", i + 1);
+            valid = 0;
+        }
+        else if (data.forecast_capacity < data.forecast_count ||
+                 data.graph.precipitation10m_capacity < data.graph.precipitation10m_count)
+        {
+            printf("Capacities below the counts after query %d.\n", i + 1);
+            valid = 0;
+        }
+        forecast[i] = data.forecast;
+        precipitation[i] = data.graph.precipitation10m;
+    }
+    if (valid && (forecast[4] != forecast[2] || precipitation[4] != precipitation[2]))
+    {
+        printf("The arrays were reallocated in steady state.\n");
+        valid = 0;
+    }
+
+    // A failure keeps the arrays, which must still be freed
+    if (meteoswiss_client_query_into(client, 8001, METEOSWISS_PRIORITY_INTERACTIVE, &data, 0, NULL) == 0)
+    {
+        printf("Unexpected query success for postal code 8001.\n");
+        valid = 0;
+    }
+    meteoswiss_data_free(&data);
+
+    meteoswiss_client_destroy(client);
+    meteoswiss_transport_destroy(transport);
+    return valid;
+}
+
+// Transport forwarding to another one, counting its requests and slowing them down
+typedef struct
+{
+    meteoswiss_transport_t transport;
+    meteoswiss_transport_t *inner;
+    unsigned int delay_ms;
+    pthread_mutex_t lock;
+    size_t requests;
+} CountingTransport;
+
+typedef struct
+{
+    CountingTransport *counting;
+    void *inner;
+} CountingConnection;
+
+static void counting_request(CountingTransport *counting, size_t count)
+{
+    pthread_mutex_lock(&counting->lock);
+    counting->requests += count;
+    pthread_mutex_unlock(&counting->lock);
+    usleep(counting->delay_ms * 1000);
+}
+
+static void *counting_open(void *state, const MeteoSwissClientConfig *config, http_share_t *share)
+{
+    CountingTransport *counting = (CountingTransport *)state;
+    CountingConnection *connection = calloc(1, sizeof(CountingConnection));
+    if (connection == NULL)
+    {
+        return NULL;
+    }
+    connection->counting = counting;
+    connection->inner = counting->inner->ops->open(counting->inner->state, config, share);
+    if (connection->inner == NULL)
+    {
+        free(connection);
+        return NULL;
+    }
+    return connection;
+}
+
+static void counting_close(void *userp)
+{
+    CountingConnection *connection = (CountingConnection *)userp;
+    connection->counting->inner->ops->close(connection->inner);
+    free(connection);
+}
+
+static int counting_get(void *userp, const HttpRequest *request, HttpResponse *response, unsigned int timeout_ms)
+{
+    CountingConnection *connection = (CountingConnection *)userp;
+    counting_request(connection->counting, 1);
+    return connection->counting->inner->ops->get(connection->inner, request, response, timeout_ms);
+}
+
+static int counting_get_hedged(void *userp, const HttpRequest *request, HttpResponse *response,
+                               unsigned int timeout_ms, unsigned int hedge_delay_ms, int *hedged)
+{
+    CountingConnection *connection = (CountingConnection *)userp;
+    counting_request(connection->counting, 1);
+    return connection->counting->inner->ops->get_hedged(connection->inner, request, response, timeout_ms,
+                                                        hedge_delay_ms, hedged);
+}
+
+static int counting_get_batch(void *userp, const HttpRequest *requests, size_t count, size_t max_in_flight,
+                              unsigned int timeout_ms, http_batch_callback callback, void *callback_userp)
+{
+    CountingConnection *connection = (CountingConnection *)userp;
+    counting_request(connection->counting, count);
+    return connection->counting->inner->ops->get_batch(connection->inner, requests, count, max_in_flight, timeout_ms,
+                                                       callback, callback_userp);
+}
+
+static void counting_destroy(void *state)
+{
+    (void)state;
+}
+
+static const TransportOps counting_ops = {counting_open,       counting_close,     NULL,            counting_get,
+                                          counting_get_hedged, counting_get_batch, counting_destroy};
+
+static void counting_init(CountingTransport *counting, meteoswiss_transport_t *inner, unsigned int delay_ms)
+{
+    memset(counting, 0, sizeof(CountingTransport));
+    counting->transport.ops = &counting_ops;
+    counting->transport.state = counting;
+    counting->inner = inner;
+    counting->delay_ms = delay_ms;
+    pthread_mutex_init(&counting->lock, NULL);
+}
+
+// Create a client on the replayed recordings, counting its requests
+static meteoswiss_client_t *counting_client_create(CountingTransport *counting, MeteoSwissClientConfig *config,
+                                                   unsigned int delay_ms)
+{
+    meteoswiss_transport_t *transport = meteoswiss_transport_replayer_create(RECORDINGS_DIR, 0);
+    if (transport == NULL)
+    {
+        printf("Failed to load the recordings of %s.\n", RECORDINGS_DIR);
+        return NULL;
+    }
+    counting_init(counting, transport, delay_ms);
+    config->transport = &counting->transport;
+
+    meteoswiss_client_t *client = meteoswiss_client_create(config);
+    if (client == NULL)
+    {
+        printf("Failed to create the client.\n");
+        meteoswiss_transport_destroy(transport);
+        pthread_mutex_destroy(&counting->lock);
+    }
+    return client;
+}
+
+static void counting_client_destroy(meteoswiss_client_t *client, CountingTransport *counting)
+{
+    meteoswiss_client_destroy(client);
+    meteoswiss_transport_destroy(counting->inner);
+    pthread_mutex_destroy(&counting->lock);
+}
+
+typedef struct
+{
+    meteoswiss_client_t *client;
+    int postal_code;
+    int status;
+    MeteoSwissData data;
+    MeteoSwissQueryStats stats;
+} QueryThread;
+
+static void *query_thread(void *userp)
+{
+    QueryThread *query = (QueryThread *)userp;
+    memset(&query->data, 0, sizeof(MeteoSwissData));
+    query->status = meteoswiss_client_query_ex(query->client, query->postal_code, &query->data, 0, &query->stats);
+    return NULL;
+}
+
+// Query a postal code from two threads at once, which must share a single request
+int run_coalescing_test(void)
+{
+    int valid = 1;
+    printf("Testing concurrent queries for the same postal code\n");
+
+    CountingTransport counting;
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    meteoswiss_client_t *client = counting_client_create(&counting, &config, 200);
+    if (client == NULL)
+    {
+        return 0;
+    }
+
+    // The second query starts while the request of the first one is slowed down
+    QueryThread first = {client, 1201, 0, {{0}}, {0}};
+    QueryThread second = {client, 1201, 0, {{0}}, {0}};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, query_thread, &first) != 0)
+    {
+        printf("Failed to start the first query.\n");
+        counting_client_destroy(client, &counting);
+        return 0;
+    }
+    usleep(50 * 1000);
+    query_thread(&second);
+    pthread_join(thread, NULL);
+
+    if (first.status != 0 || second.status != 0)
+    {
+        printf("Unexpected failure of the concurrent queries: %d and %d.\n", first.status, second.status);
+        valid = 0;
+    }
+    else if (!same_data(&first.data, &second.data) || !validate_data(&second.data, 0))
+    {
+        printf("The concurrent queries got different results.\n");
+        valid = 0;
+    }
+    if (counting.requests != 1 || first.stats.coalesced || !second.stats.coalesced)
+    {
+        printf("The concurrent queries made %zu requests instead of one.\n", counting.requests);
+        valid = 0;
+    }
+
+    meteoswiss_data_free(&first.data);
+    meteoswiss_data_free(&second.data);
+    counting_client_destroy(client, &counting);
+    return valid;
+}
+
+// Check the attempts and the rate limiter wait reported by queries
+int run_query_stats_test(void)
+{
+    int valid = 1;
+    printf("Testing the query details of retried and throttled queries\n");
+
+    CountingTransport counting;
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    config.max_attempts = 3;
+    config.backoff_base_ms = 1;
+    config.backoff_max_ms = 1;
+    config.rate_limit = 20;
+    config.rate_burst = 1;
+    meteoswiss_client_t *client = counting_client_create(&counting, &config, 0);
+    if (client == NULL)
+    {
+        return 0;
+    }
+
+    MeteoSwissData data;
+    MeteoSwissQueryStats stats;
+    memset(&data, 0, sizeof(MeteoSwissData));
+    if (meteoswiss_client_query_ex(client, 1201, &data, 0, &stats) != 0 || stats.attempts != 1 ||
+        stats.http_status != 200 || stats.body_size == 0 || stats.throttle_us != 0)
+    {
+        printf("Unexpected details of the first query: %u attempts, status %ld, throttled %lld us.\n",
+               stats.attempts, stats.http_status, stats.throttle_us);
+        valid = 0;
+    }
+    meteoswiss_data_free(&data);
+
+    // The bucket is empty, the next token comes 50 ms later
+    if (meteoswiss_client_query_ex(client, 1201, &data, 0, &stats) != 0 || stats.throttle_us < 25000)
+    {
+        printf("The second query was throttled %lld us instead of about 50 ms.\n", stats.throttle_us);
+        valid = 0;
+    }
+    meteoswiss_data_free(&data);
+
+    // 8001 is not recorded, every attempt fails and is retried
+    size_t requests = counting.requests;
+    if (meteoswiss_client_query_ex(client, 8001, &data, 0, &stats) == 0 || stats.attempts != 3 ||
+        counting.requests - requests != 3)
+    {
+        printf("The failing query reported %u attempts for %zu requests instead of 3.\n", stats.attempts,
+               counting.requests - requests);
+        valid = 0;
+    }
+    meteoswiss_data_free(&data);
+
+    counting_client_destroy(client, &counting);
+    return valid;
+}
+
+// Send a burst of queries beyond the bucket of the rate limiter
+int run_rate_limit_test(void)
+{
+    int valid = 1;
+    printf("Testing a burst of queries beyond the rate limit\n");
+
+    CountingTransport counting;
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    config.rate_limit = 1;
+    config.rate_burst = 2;
+    meteoswiss_client_t *client = counting_client_create(&counting, &config, 0);
+    if (client == NULL)
+    {
+        return 0;
+    }
+
+    // The burst goes through at once, the next query cannot get a token within its timeout
+    static const int expected[] = {METEOSWISS_SUCCESS, METEOSWISS_SUCCESS, METEOSWISS_ERROR_RATE_LIMITED};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        MeteoSwissData data;
+        MeteoSwissQueryStats stats;
+        memset(&data, 0, sizeof(MeteoSwissData));
+        int status = meteoswiss_client_query_ex(client, 1201, &data, 200, &stats);
+        if (status != expected[i] || stats.throttle_us > 100000)
+        {
+            printf("Query %zu returned %d after %lld us of throttling, expected %d.\n", i + 1, status,
+                   stats.throttle_us, expected[i]);
+            valid = 0;
+        }
+        meteoswiss_data_free(&data);
+    }
+    if (counting.requests != 2)
+    {
+        printf("The burst sent %zu requests instead of 2.\n", counting.requests);
+        valid = 0;
+    }
+
+    // Nor can a batch get the tokens of its first group within its timeout
+    const int postal_codes[] = {1201, 1201, 1201};
+    MeteoSwissData data[3];
+    int status[3];
+    meteoswiss_client_query_batch(client, postal_codes, 3, data, status, 0, 200);
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (status[i] != METEOSWISS_ERROR_RATE_LIMITED)
+        {
+            printf("Batch entry %zu returned %d instead of being rate limited.\n", i, status[i]);
+            valid = 0;
+        }
+        meteoswiss_data_free(&data[i]);
+    }
+    if (counting.requests != 2)
+    {
+        printf("The rate limited batch sent %zu requests.\n", counting.requests - 2);
+        valid = 0;
+    }
+
+    counting_client_destroy(client, &counting);
+    return valid;
+}
+
+// Save the TLS sessions of a share and load them into another one
+int run_tls_sessions_test(void)
+{
+    int valid = 1;
+    printf("Testing a TLS sessions save and load round trip\n");
+
+    meteoswiss_share_t *saved = meteoswiss_share_create();
+    meteoswiss_share_t *loaded = meteoswiss_share_create();
+    if (saved == NULL || loaded == NULL)
+    {
+        printf("Failed to create the shares.\n");
+        meteoswiss_share_destroy(saved);
+        meteoswiss_share_destroy(loaded);
+        return 0;
+    }
+
+    int result = meteoswiss_share_save_tls_sessions(saved, TLS_SESSIONS_FILE);
+    if (result == METEOSWISS_ERROR_UNSUPPORTED)
+    {
+        printf("TLS session export is not supported, skipped.\n");
+    }
+    else if (result != 0)
+    {
+        printf("Unexpected failure saving the TLS sessions.\n");
+        valid = 0;
+    }
+    else
+    {
+        // The file grants the resumption of the sessions, only the owner may read it
+        struct stat info;
+        if (stat(TLS_SESSIONS_FILE, &info) != 0 || (info.st_mode & 0077) != 0)
+        {
+            printf("The TLS sessions file is readable by other users.\n");
+            valid = 0;
+        }
+        if (meteoswiss_share_load_tls_sessions(loaded, TLS_SESSIONS_FILE) != 0)
+        {
+            printf("Unexpected failure loading the TLS sessions.\n");
+            valid = 0;
+        }
+        unlink(TLS_SESSIONS_FILE);
+    }
+
+    if (meteoswiss_share_load_tls_sessions(loaded, TLS_SESSIONS_FILE) == 0)
+    {
+        printf("Unexpected success loading a missing TLS sessions file.\n");
+        valid = 0;
+    }
+
+    // Sessions of absurd sizes or that libcurl cannot import make the file corrupt
+    static const uint32_t lengths[][2] = {{0xffffffffu, 0xffffffffu}, {16, 0x7fffffffu}, {0, 16}, {16, 16}};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        FILE *file = fopen(TLS_SESSIONS_FILE, "wb");
+        if (file == NULL)
+        {
+            printf("Failed to write a corrupt TLS sessions file.\n");
+            valid = 0;
+            break;
+        }
+        int64_t expiry = (int64_t)time(NULL) + 3600;
+        unsigned char garbage[32];
+        memset(garbage, 0xa5, sizeof(garbage));
+        fputs("MeteoSwissTLS1\n", file);
+        fwrite(&expiry, sizeof(expiry), 1, file);
+        fwrite(lengths[i], sizeof(lengths[i]), 1, file);
+        fwrite(garbage, 1, sizeof(garbage), file);
+        fclose(file);
+
+        if (meteoswiss_share_load_tls_sessions(loaded, TLS_SESSIONS_FILE) == 0)
+        {
+            printf("Unexpected success loading a TLS session of %u + %u bytes.\n", lengths[i][0], lengths[i][1]);
+            valid = 0;
+        }
+        unlink(TLS_SESSIONS_FILE);
+    }
+
+    meteoswiss_share_destroy(saved);
+    meteoswiss_share_destroy(loaded);
+    return valid;
+}
+
+// Minimal poll() event loop driving an asynchronous context
+typedef struct
+{
+    struct pollfd fds[ASYNC_MAX_SOCKETS];
+    int fd_count;
+    long timeout_ms;
+    const int *expect_failure;
+    int valid;
+} AsyncLoop;
+
+// Expected outcome of one asynchronous query
+typedef struct
+{
+    AsyncLoop *loop;
+    int expect_failure;
+} AsyncExpectation;
+
+static void async_socket(void *userp, int fd, int events)
+{
+    AsyncLoop *loop = (AsyncLoop *)userp;
+    int i = 0;
+    while (i < loop->fd_count && loop->fds[i].fd != fd)
+        i++;
+
+    if (events & METEOSWISS_POLL_REMOVE)
+    {
+        if (i < loop->fd_count)
+            loop->fds[i] = loop->fds[--loop->fd_count];
+        return;
+    }
+    if (i == loop->fd_count)
+    {
+        if (loop->fd_count == ASYNC_MAX_SOCKETS)
+            return;
+        loop->fd_count++;
+    }
+    loop->fds[i].fd = fd;
+    loop->fds[i].events = ((events & METEOSWISS_POLL_IN) ? POLLIN : 0) | ((events & METEOSWISS_POLL_OUT) ? POLLOUT : 0);
+}
+
+static void async_timer(void *userp, long timeout_ms)
+{
+    ((AsyncLoop *)userp)->timeout_ms = timeout_ms;
+}
+
+static void async_done(void *userp, int postal_code, int status, MeteoSwissData *data,
+                       const MeteoSwissQueryStats *stats)
+{
+    AsyncExpectation *expectation = (AsyncExpectation *)userp;
+    AsyncLoop *loop = expectation->loop;
+    (void)stats;
+
+    if ((status != 0) != expectation->expect_failure)
+    {
+        printf("Unexpected async %s for postal code %d.\n", (status ? "failure" : "success"), postal_code);
+        loop->valid = 0;
+    }
+    else if (data && !validate_data(data, 0))
+    {
+        printf("Unexpected validation failure for postal code %d.\n", postal_code);
+        loop->valid = 0;
+    }
+    if (data)
+        meteoswiss_data_free(data);
+}
+
+// Run concurrent queries on an asynchronous context driven by poll()
+int run_async_test(const int *postal_codes, const int *expect_failure, size_t count)
+{
+    AsyncLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.timeout_ms = -1;
+    loop.valid = 1;
+
+    printf("Testing %zu asynchronous queries\n", count);
+    meteoswiss_async_t *async = meteoswiss_async_create(NULL, async_socket, async_timer, &loop);
+    if (async == NULL)
+    {
+        printf("Failed to create the asynchronous context.\n");
+        return 0;
+    }
+
+    AsyncExpectation expectations[8];
+    for (size_t i = 0; i < count; i++)
+    {
+        expectations[i].loop = &loop;
+        expectations[i].expect_failure = expect_failure[i];
+        if (meteoswiss_async_query(async, postal_codes[i], 10000, async_done, &expectations[i]) != 0)
+        {
+            printf("Failed to start the query of postal code %d.\n", postal_codes[i]);
+            loop.valid = 0;
+        }
+    }
+
+    while (meteoswiss_async_running(async) > 0)
+    {
+        int ready = poll(loop.fds, loop.fd_count, (int)loop.timeout_ms);
+        if (ready < 0)
+        {
+            loop.valid = 0;
+            break;
+        }
+        if (ready == 0)
+        {
+            loop.timeout_ms = -1;
+            meteoswiss_async_timeout(async);
+            continue;
+        }
+
+        // Copied first, the callbacks change the set of sockets
+        struct pollfd fds[ASYNC_MAX_SOCKETS];
+        int fd_count = loop.fd_count;
+        memcpy(fds, loop.fds, sizeof(fds));
+        for (int i = 0; i < fd_count; i++)
+        {
+            int events = ((fds[i].revents & POLLIN) ? METEOSWISS_POLL_IN : 0) |
+                         ((fds[i].revents & POLLOUT) ? METEOSWISS_POLL_OUT : 0) |
+                         ((fds[i].revents & (POLLERR | POLLHUP)) ? METEOSWISS_POLL_ERROR : 0);
+            if (events)
+                meteoswiss_async_socket_action(async, fds[i].fd, events);
+        }
+    }
+
+    meteoswiss_async_destroy(async);
+    return loop.valid;
+}
+
+// Trip the breaker of a client replaying the recordings, then probe it from a batch
+int run_breaker_test(void)
+{
+    printf("Testing the circuit breaker probe of a batch\n");
+
+    meteoswiss_transport_t *transport = meteoswiss_transport_replayer_create(RECORDINGS_DIR, 0);
+    if (transport == NULL)
+    {
+        printf("Failed to load the recordings of %s.\n", RECORDINGS_DIR);
+        return 0;
+    }
+
+    MeteoSwissClientConfig config;
+    meteoswiss_client_config_init(&config);
+    config.transport = transport;
+    config.breaker_failure_percent = 50;
+    config.breaker_min_requests = 4;
+    config.breaker_open_ms = 50;
+    meteoswiss_client_t *client = meteoswiss_client_create(&config);
+    if (client == NULL)
+    {
+        printf("Failed to create the client.\n");
+        meteoswiss_transport_destroy(transport);
+        return 0;
+    }
+
+    // Only 1201 is recorded, the other postal codes fail
+    int valid = 1;
+    const int failing[] = {2000, 2001, 2002, 2003, 2004, 2005};
+    MeteoSwissData data[6];
+    int status[6];
+    meteoswiss_client_query_batch(client, failing, 6, data, status, 0, 0);
+    for (int i = 0; i < 6; i++)
+        meteoswiss_data_free(&data[i]);
+    if (meteoswiss_client_circuit_state(client) != METEOSWISS_CIRCUIT_OPEN)
+    {
+        printf("The breaker did not open after the failures.\n");
+        valid = 0;
+    }
+
+    // A failed probe opens the breaker again before the rest of the batch is sent
+    usleep(60 * 1000);
+    const int failed_probe[] = {2000, 1201, 1201};
+    meteoswiss_client_query_batch(client, failed_probe, 3, data, status, 0, 0);
+    for (int i = 0; i < 3; i++)
+        meteoswiss_data_free(&data[i]);
+    if (status[0] == 0 || status[1] != METEOSWISS_ERROR_CIRCUIT_OPEN || status[2] != METEOSWISS_ERROR_CIRCUIT_OPEN)
+    {
+        printf("Unexpected statuses %d, %d, %d after a failed probe.\n", status[0], status[1], status[2]);
+        valid = 0;
+    }
+
+    // A successful probe closes it, and the rest of the batch goes through
+    usleep(60 * 1000);
+    const int good_probe[] = {1201, 1201, 1201};
+    meteoswiss_client_query_batch(client, good_probe, 3, data, status, 0, 0);
+    for (int i = 0; i < 3; i++)
+    {
+        if (status[i] != 0)
+        {
+            printf("Unexpected status %d after a successful probe.\n", status[i]);
+            valid = 0;
+        }
+        meteoswiss_data_free(&data[i]);
+    }
+    if (meteoswiss_client_circuit_state(client) != METEOSWISS_CIRCUIT_CLOSED)
+    {
+        printf("The breaker did not close after a successful probe.\n");
+        valid = 0;
+    }
+
+    meteoswiss_client_destroy(client);
+    meteoswiss_transport_destroy(transport);
+    return valid;
+}
+
+// Query of the destroy test, started again from its callback
+typedef struct
+{
+    meteoswiss_async_t *async;
+    int calls;
+    int requery_status;
+} AsyncRequery;
+
+static void async_requery(void *userp, int postal_code, int status, MeteoSwissData *data,
+                          const MeteoSwissQueryStats *stats)
+{
+    AsyncRequery *requery = (AsyncRequery *)userp;
+    (void)status;
+    (void)stats;
+
+    if (data)
+        meteoswiss_data_free(data);
+    if (requery->calls++ == 0)
+        requery->requery_status = meteoswiss_async_query(requery->async, postal_code, 0, async_requery, requery);
+}
+
+// Destroy a context whose query callback starts another query
+int run_async_destroy_test(void)
+{
+    AsyncLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.timeout_ms = -1;
+
+    printf("Testing a query started while the asynchronous context is destroyed\n");
+    AsyncRequery requery = {NULL, 0, 0};
+    requery.async = meteoswiss_async_create(NULL, async_socket, async_timer, &loop);
+    if (requery.async == NULL)
+    {
+        printf("Failed to create the asynchronous context.\n");
+        return 0;
+    }
+
+    // The loop is never run, the query is still pending when the context is destroyed
+    if (meteoswiss_async_query(requery.async, 1201, 0, async_requery, &requery) != 0)
+    {
+        printf("Failed to start the query.\n");
+        meteoswiss_async_destroy(requery.async);
+        return 0;
+    }
+    meteoswiss_async_destroy(requery.async);
+
+    int valid = 1;
+    if (requery.calls != 1)
+    {
+        printf("The callback was called %d times instead of once.\n", requery.calls);
+        valid = 0;
+    }
+    if (requery.requery_status == 0)
+    {
+        printf("Unexpected start of a query during the destruction.\n");
+        valid = 0;
+    }
+    return valid;
+}
+
 int main()
 {
     // Define test cases
@@ -130,14 +1212,103 @@ int main()
         {1700, 1, 1}, // Geneva - Minimal timeout, expected to fail
     };
 
-    int total_tests = sizeof(test_cases) / sizeof(test_cases[0]);
+    int num_cases = sizeof(test_cases) / sizeof(test_cases[0]);
+    int total_tests = 0;
     int passed_tests = 0;
 
+    meteoswiss_client_t *client = meteoswiss_client_create(NULL);
+
+    MeteoSwissClientConfig streaming_config;
+    meteoswiss_client_config_init(&streaming_config);
+    streaming_config.streaming_parse = 1;
+    meteoswiss_client_t *streaming_client = meteoswiss_client_create(&streaming_config);
+
+    if (client == NULL || streaming_client == NULL)
+    {
+        printf("ERROR: Failed to create the client\n");
+        return 1;
+    }
+
+    // Run every case once with the one-shot API, then again on a shared client,
+    // then on a client parsing the responses while they download
+    meteoswiss_client_t *clients[] = {NULL, client, streaming_client};
+
     printf("Running MeteoSwiss API tests...\n");
-    for (int i = 0; i < total_tests; i++)
+    for (int c = 0; c < 3; c++)
     {
-        printf("\n################# Running test %d #################\n", i);
-        if (run_test(test_cases[i].postal_code, test_cases[i].expect_failure, test_cases[i].timeout))
+        for (int i = 0; i < num_cases; i++)
+        {
+            printf("\n################# Running test %d #################\n", total_tests);
+            total_tests++;
+            if (run_test(clients[c], test_cases[i].postal_code, test_cases[i].expect_failure, test_cases[i].timeout))
+            {
+                printf(">>PASSED<<\n");
+                passed_tests++;
+            }
+            else
+            {
+                printf(">>FAILED<<\n");
+            }
+        }
+    }
+
+    // Same valid and invalid postal codes, fetched concurrently
+    const int batch_postal_codes[] = {1201, 8001, 1003, 0000};
+    const int batch_expect_failure[] = {0, 0, 0, 1};
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_batch_test(client, batch_postal_codes, batch_expect_failure, 4))
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    // Same postal codes, fetched from an application event loop
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_async_test(batch_postal_codes, batch_expect_failure, 4))
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_json_number_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_parser_equivalence_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    // A recorded response, parsed once downloaded and then while it streams
+    for (int streaming_parse = 0; streaming_parse < 2; streaming_parse++)
+    {
+        printf("\n################# Running test %d #################\n", total_tests);
+        total_tests++;
+        if (run_replay_test(streaming_parse))
         {
             printf(">>PASSED<<\n");
             passed_tests++;
@@ -148,6 +1319,93 @@ int main()
         }
     }
 
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_query_into_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_coalescing_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_query_stats_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_rate_limit_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_tls_sessions_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_breaker_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    printf("\n################# Running test %d #################\n", total_tests);
+    total_tests++;
+    if (run_async_destroy_test())
+    {
+        printf(">>PASSED<<\n");
+        passed_tests++;
+    }
+    else
+    {
+        printf(">>FAILED<<\n");
+    }
+
+    meteoswiss_client_destroy(client);
+    meteoswiss_client_destroy(streaming_client);
+
     // Summary
     printf("\nTest Summary:\n");
     printf("Total tests: %d\n", total_tests);